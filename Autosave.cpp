@@ -0,0 +1,277 @@
+#include "stdafx.h"
+#include "Autosave.h"
+#include <QDataStream>
+#include <QSaveFile>
+#include <QScopedPointer>
+#include <QTextBlock>
+#include <QTextCursor>
+#include <QTextDocumentFragment>
+#include <QThread>
+#include <QTimer>
+#include "HtmlWriter.h"
+#include "Timing.h"
+
+namespace {
+
+const quint32 JournalMagic = 0x484a4e31;   // "HJN1"
+const QDataStream::Version StreamVersion = QDataStream::Qt_5_6;
+// a change adding more characters is left to the next snapshot
+const int RecordLimit = 64 * 1024;
+// first line of a snapshot, followed by its generation
+const char SnapshotMark[] = "<!-- autosave ";
+
+// a record is its kind, position, removed length and payload; an image
+// record has no position, its payload is the name followed by format and bytes
+enum RecordKind : quint8 {
+    TextRecord,   // plain text in the format before it
+    HtmlRecord,   // a fragment carrying its formats, images by name
+    ImageRecord   // an image the following records name
+};
+
+}
+
+Autosave::Autosave(QTextDocument* document, const QString& path, const ImageStore* images, QObject* parent)
+  : QObject(parent), mDocument(document), mPath(path), mImages(images) {
+  qRegisterMetaType<AutosaveSnapshot>();
+  qRegisterMetaType<AutosaveRecords>();
+  mThread = new QThread(this);
+  mWorker = new AutosaveWorker(path);
+  mWorker->moveToThread(mThread);
+  connect(mThread, &QThread::finished, mWorker, &QObject::deleteLater);
+  connect(this, &Autosave::snapshotTaken, mWorker, &AutosaveWorker::writeSnapshot);
+  connect(this, &Autosave::recordsReady, mWorker, &AutosaveWorker::append);
+  connect(mWorker, &AutosaveWorker::snapshotWritten, this, &Autosave::snapshotWritten);
+  mThread->start();
+
+  mTimer = new QTimer(this);
+  mTimer->setSingleShot(true);
+  mTimer->setInterval(5000);
+  connect(mTimer, &QTimer::timeout, this, &Autosave::save);
+  connect(document, &QTextDocument::contentsChange, this, &Autosave::contentsChange);
+  snapshot();
+}
+
+Autosave::~Autosave() {
+  if (mSnapshotDue && mDocument) snapshot();
+  // queued after everything sent before, so the worker is done when it returns
+  QMetaObject::invokeMethod(mWorker, "append", Qt::BlockingQueuedConnection, Q_ARG(AutosaveRecords, takeRecords()));
+  mThread->quit();
+  mThread->wait();
+}
+
+void Autosave::setInterval(int msec) {
+  mTimer->setInterval(msec);
+}
+
+void Autosave::contentsChange(int position, int removed, int added) {
+  if (mSnapshotDue) return;
+  if (added > RecordLimit) {
+    mSnapshotDue = true;
+    mRecords.clear();
+    if (mTimer->interval() > 0) mTimer->start();
+    return;
+  }
+  Timing::Scope timing("autosave.record", added);
+  const int end = qMin(position + added, mDocument->characterCount() - 1);
+
+  // typed text continues the run before it, the replay gives it that format
+  bool plain = added == 0;
+  if (!plain && position > 0) {
+    const QTextBlock block = mDocument->findBlock(position - 1);
+    for (QTextBlock::iterator it = block.begin(); !it.atEnd(); ++it) {
+      const QTextFragment fragment = it.fragment();
+      if (fragment.position() + fragment.length() > position - 1) {
+        plain = fragment.position() <= position - 1 && end <= fragment.position() + fragment.length()
+            && !fragment.charFormat().isImageFormat();
+        break;
+      }
+    }
+  }
+
+  QTextCursor cursor(mDocument);
+  cursor.setPosition(position);
+  cursor.setPosition(end, QTextCursor::KeepAnchor);
+  QString payload;
+  if (plain) {
+    payload = cursor.selectedText();
+  } else {
+    // images stay names, the worker writes their bytes
+    payload = QTextDocumentFragment(cursor).toHtml();
+    for (QTextBlock block = mDocument->findBlock(position); block.isValid() && block.position() < end;
+         block = block.next()) {
+      for (QTextBlock::iterator it = block.begin(); !it.atEnd(); ++it) {
+        const QTextFragment fragment = it.fragment();
+        if (fragment.position() >= end) break;
+        if (fragment.position() + fragment.length() <= position) continue;
+        const QTextCharFormat format = fragment.charFormat();
+        if (format.isImageFormat()) mRecordImages.insert(format.toImageFormat().name());
+      }
+    }
+  }
+
+  const int size = mRecords.size();
+  QDataStream out(&mRecords, QIODevice::WriteOnly | QIODevice::Append);
+  out.setVersion(StreamVersion);
+  out << quint8(plain ? TextRecord : HtmlRecord) << qint32(position) << qint32(removed) << payload;
+  mJournalSize += mRecords.size() - size;
+  if (mTimer->interval() > 0 && !mTimer->isActive()) mTimer->start();
+}
+
+void Autosave::save() {
+  mTimer->stop();
+  if (mSnapshotDue || mJournalSize > mJournalLimit) {
+    snapshot();
+    return;
+  }
+  if (mRecords.isEmpty()) return;
+  emit recordsReady(takeRecords());
+}
+
+AutosaveRecords Autosave::takeRecords() {
+  AutosaveRecords records;
+  records.records = mRecords;
+  mRecords.clear();
+  if (mImages) {
+    records.images = *mImages;
+    // names still encoding go with a later save
+    for (auto it = mRecordImages.begin(); it != mRecordImages.end();) {
+      if (!mImages->contains(*it)) {
+        ++it;
+        continue;
+      }
+      records.names << *it;
+      it = mRecordImages.erase(it);
+    }
+  }
+  return records;
+}
+
+void Autosave::snapshot() {
+  mTimer->stop();
+  Timing::Scope timing("autosave.snapshot", mDocument->characterCount());
+  AutosaveSnapshot snapshot;
+  snapshot.document = mDocument->clone();
+  snapshot.document->moveToThread(mThread);
+  if (mImages) snapshot.images = *mImages;
+  snapshot.generation = ++mGeneration;
+  // the clone holds every change so far
+  mRecords.clear();
+  mRecordImages.clear();
+  mJournalSize = 0;
+  mSnapshotDue = false;
+  emit snapshotTaken(snapshot);
+}
+
+void Autosave::snapshotWritten(quint32 generation, bool ok) {
+  // the next save tries again, unless a later snapshot is already on its way
+  if (!ok && generation == mGeneration) {
+    mSnapshotDue = true;
+    mRecords.clear();
+    if (mTimer->interval() > 0) mTimer->start();
+  }
+  emit snapshotSaved(ok);
+}
+
+bool Autosave::recover(const QString& path, QTextDocument* document, ImageStore* images) {
+  QFile file(path);
+  if (!file.open(QIODevice::ReadOnly)) return false;
+  const QByteArray mark = file.readLine();
+  if (!mark.startsWith(SnapshotMark)) return false;
+  const int from = int(sizeof(SnapshotMark)) - 1;
+  const quint32 generation = mark.mid(from, mark.indexOf(' ', from) - from).toUInt();
+  const QString html = QString::fromUtf8(file.readAll());
+  document->setHtml(images ? images->absorb(html) : html);
+  // without a store the journal's images become data URIs again
+  ImageStore journalImages;
+  ImageStore* store = images ? images : &journalImages;
+
+  QFile journal(path + ".journal");
+  if (!journal.open(QIODevice::ReadOnly)) return true;
+  QDataStream in(&journal);
+  in.setVersion(StreamVersion);
+  quint32 magic = 0, journalGeneration = 0;
+  in >> magic >> journalGeneration;
+  // a journal of another snapshot is already part of this one or lost with it
+  if (in.status() != QDataStream::Ok || magic != JournalMagic || journalGeneration != generation) return true;
+
+  const bool undo = document->isUndoRedoEnabled();
+  document->setUndoRedoEnabled(false);
+  QTextCursor cursor(document);
+  forever {
+    quint8 kind;
+    qint32 position, removed;
+    QString payload;
+    in >> kind >> position >> removed >> payload;
+    // the end, or a record cut short by the crash
+    if (in.status() != QDataStream::Ok) break;
+    if (kind == ImageRecord) {
+      QByteArray format, bytes;
+      in >> format >> bytes;
+      if (in.status() != QDataStream::Ok) break;
+      const QString name = store->add(bytes, format);
+      if (name != payload) store->addAlias(payload, name);
+      continue;
+    }
+    const int last = document->characterCount() - 1;
+    if (position < 0 || position > last) break;
+    cursor.setPosition(position);
+    cursor.setPosition(position + qBound(0, int(removed), last - position), QTextCursor::KeepAnchor);
+    cursor.removeSelectedText();
+    if (payload.isEmpty()) continue;
+    if (kind == TextRecord) {
+      // takes the format of the character before
+      cursor.setPosition(position);
+      cursor.insertText(payload);
+    } else {
+      cursor.insertFragment(QTextDocumentFragment::fromHtml(images ? images->absorb(payload) : journalImages.serialize(payload)));
+    }
+  }
+  document->setUndoRedoEnabled(undo);
+  return true;
+}
+
+void AutosaveWorker::writeSnapshot(const AutosaveSnapshot& snapshot) {
+  QScopedPointer<QTextDocument> document(snapshot.document);
+  // the former snapshot stays until this one is complete
+  QSaveFile file(mPath);
+  bool ok = file.open(QIODevice::WriteOnly);
+  if (ok) {
+    file.write(SnapshotMark + QByteArray::number(snapshot.generation) + " -->\n");
+    HtmlWriter writer(document.data());
+    writer.setImageStore(&snapshot.images);
+    ok = writer.write(&file) && file.commit();
+  }
+  // the records since the former snapshot are gone, so on failure nothing
+  // may be appended to its journal any more
+  if (!ok) mJournal.close();
+  if (ok) {
+    mJournal.close();
+    mJournaledImages.clear();
+    mJournal.setFileName(mPath + ".journal");
+    ok = mJournal.open(QIODevice::WriteOnly | QIODevice::Truncate);
+    if (ok) {
+      QDataStream out(&mJournal);
+      out.setVersion(StreamVersion);
+      out << JournalMagic << snapshot.generation;
+      ok = mJournal.flush();
+    }
+  }
+  emit snapshotWritten(snapshot.generation, ok);
+}
+
+void AutosaveWorker::append(const AutosaveRecords& records) {
+  if (records.records.isEmpty() || !mJournal.isOpen()) return;
+  // the images first, the records after them name them
+  QByteArray images;
+  QDataStream out(&images, QIODevice::WriteOnly);
+  out.setVersion(StreamVersion);
+  for (const QString& name : records.names) {
+    if (mJournaledImages.contains(name)) continue;
+    mJournaledImages.insert(name);
+    out << quint8(ImageRecord) << qint32(0) << qint32(0) << name
+        << records.images.format(name) << records.images.bytes(name);
+  }
+  mJournal.write(images);
+  mJournal.write(records.records);
+  mJournal.flush();
+}
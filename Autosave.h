@@ -0,0 +1,116 @@
+#ifndef AUTOSAVE_H
+#define AUTOSAVE_H
+
+#include <QFile>
+#include <QMetaType>
+#include <QObject>
+#include <QPointer>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+#include <QTextDocument>
+#include "ImageStore.h"
+
+class QThread;
+class QTimer;
+
+// a copy of the document handed to the worker, which deletes it
+struct AutosaveSnapshot {
+  QTextDocument* document = nullptr;
+  ImageStore images;      // implicitly shared with the editor's store
+  quint32 generation = 0;
+};
+
+// records for the journal and the images they name, the worker writes
+// the image bytes so the GUI thread never encodes them
+struct AutosaveRecords {
+  QByteArray records;
+  ImageStore images;      // implicitly shared with the editor's store
+  QStringList names;
+};
+
+Q_DECLARE_METATYPE(AutosaveSnapshot)
+Q_DECLARE_METATYPE(AutosaveRecords)
+
+class AutosaveWorker;
+
+// Saves a document for crash recovery without serializing it on the GUI
+// thread. Every change becomes a small record of what was replaced where,
+// naming images instead of holding their data; save() hands the records
+// to a worker thread that appends them, and the bytes of the images they
+// name, to a journal next to the snapshot. Once the journal has grown past a limit,
+// or a change is too big to record, the document is cloned and the worker
+// writes the clone as the new snapshot, starting a new journal. recover()
+// loads the snapshot and replays the journal that belongs to it.
+class Autosave : public QObject {
+  Q_OBJECT
+public:
+  // takes the first snapshot, the journal is path + ".journal"; images
+  // named by the document are written as data URIs from the store
+  Autosave(QTextDocument* document, const QString& path, const ImageStore* images = nullptr,
+           QObject* parent = nullptr);
+  ~Autosave();
+
+  // delay between a change and the save it triggers, 0 saves only on save()
+  void setInterval(int msec);
+  // journal bytes after which save() takes a snapshot instead
+  void setJournalLimit(int bytes) { mJournalLimit = bytes; }
+
+  QString path() const { return mPath; }
+  QString journalPath() const { return mPath + ".journal"; }
+
+  // the saved document into document, false when there is no snapshot
+  static bool recover(const QString& path, QTextDocument* document, ImageStore* images = nullptr);
+
+public slots:
+  void save();
+  void snapshot();
+
+signals:
+  void snapshotSaved(bool ok);
+
+  // to the worker
+  void snapshotTaken(const AutosaveSnapshot& snapshot);
+  void recordsReady(const AutosaveRecords& records);
+
+private slots:
+  void contentsChange(int position, int removed, int added);
+  void snapshotWritten(quint32 generation, bool ok);
+
+private:
+  AutosaveRecords takeRecords();
+
+  QPointer<QTextDocument> mDocument;
+  QString mPath;
+  const ImageStore* mImages;
+  QThread* mThread;
+  AutosaveWorker* mWorker;
+  QTimer* mTimer;
+  QByteArray mRecords;         // not yet handed to the worker
+  QSet<QString> mRecordImages; // named by records, not yet handed to the worker
+  int mJournalSize = 0;        // bytes since the last snapshot
+  int mJournalLimit = 4 * 1024 * 1024;
+  quint32 mGeneration = 0;
+  bool mSnapshotDue = false;   // a change was not recorded, the next save takes a snapshot
+};
+
+// Writes snapshots and appends journal records on its own thread.
+class AutosaveWorker : public QObject {
+  Q_OBJECT
+public:
+  explicit AutosaveWorker(const QString& path) : mPath(path) {}
+
+public slots:
+  void writeSnapshot(const AutosaveSnapshot& snapshot);
+  void append(const AutosaveRecords& records);
+
+signals:
+  void snapshotWritten(quint32 generation, bool ok);
+
+private:
+  QString mPath;
+  QFile mJournal;
+  QSet<QString> mJournaledImages;   // in the journal already
+};
+
+#endif // AUTOSAVE_H
@@ -0,0 +1,93 @@
+#include "stdafx.h"
+#include "Base64.h"
+#include <QIODevice>
+#include <string.h>
+
+namespace {
+
+// output characters per piece written to a device
+const int ChunkChars = 64 * 1024;
+
+struct PairTable {
+  char pairs[4096 * 2];
+  PairTable() {
+    static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    for (int i = 0; i < 4096; ++i) {
+      pairs[2 * i] = alphabet[i >> 6];
+      pairs[2 * i + 1] = alphabet[i & 0x3f];
+    }
+  }
+};
+
+const char* pairs() {
+  static const PairTable table;
+  return table.pairs;
+}
+
+}
+
+int Base64::encodedSize(int size, int lineLength) {
+  const int chars = (size + 2) / 3 * 4;
+  if (lineLength <= 0 || chars == 0) return chars;
+  return chars + (chars - 1) / lineLength;
+}
+
+char* Base64::encodeLine(const uchar* data, int size, char* out) {
+  static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  const char* table = pairs();
+  const uchar* end = data + size - size % 3;
+  for (; data != end; data += 3, out += 4) {
+    const uint v = uint(data[0]) << 16 | uint(data[1]) << 8 | data[2];
+    memcpy(out, table + 2 * (v >> 12), 2);
+    memcpy(out + 2, table + 2 * (v & 0xfff), 2);
+  }
+  switch (size % 3) {
+  case 1:
+    out[0] = alphabet[data[0] >> 2];
+    out[1] = alphabet[(data[0] & 0x03) << 4];
+    out[2] = out[3] = '=';
+    out += 4;
+    break;
+  case 2:
+    out[0] = alphabet[data[0] >> 2];
+    out[1] = alphabet[(data[0] & 0x03) << 4 | data[1] >> 4];
+    out[2] = alphabet[(data[1] & 0x0f) << 2];
+    out[3] = '=';
+    out += 4;
+    break;
+  }
+  return out;
+}
+
+int Base64::encode(const char* data, int size, char* out, int lineLength) {
+  Q_ASSERT(lineLength % 4 == 0);
+  const uchar* in = reinterpret_cast<const uchar*>(data);
+  if (lineLength <= 0) return int(encodeLine(in, size, out) - out);
+  const int lineBytes = lineLength / 4 * 3;
+  char* p = out;
+  for (int pos = 0; pos < size; pos += lineBytes) {
+    if (pos) *p++ = '\n';
+    p = encodeLine(in + pos, qMin(lineBytes, size - pos), p);
+  }
+  return int(p - out);
+}
+
+QByteArray Base64::encode(const QByteArray& data, int lineLength) {
+  QByteArray out(encodedSize(data.size(), lineLength), Qt::Uninitialized);
+  encode(data.constData(), data.size(), out.data(), lineLength);
+  return out;
+}
+
+bool Base64::encode(const char* data, qint64 size, QIODevice* device, int lineLength) {
+  // whole lines per piece, so wrapping carries on across pieces
+  const int lineBytes = lineLength > 0 ? lineLength / 4 * 3 : 3;
+  const int chunk = qMax(1, ChunkChars / 4 * 3 / lineBytes) * lineBytes;
+  QByteArray buffer(encodedSize(chunk, lineLength) + 1, Qt::Uninitialized);
+  for (qint64 pos = 0; pos < size; pos += chunk) {
+    char* out = buffer.data();
+    if (pos && lineLength > 0) *out++ = '\n';
+    out += encode(data + pos, int(qMin<qint64>(chunk, size - pos)), out, lineLength);
+    if (device->write(buffer.constData(), out - buffer.constData()) == -1) return false;
+  }
+  return true;
+}
@@ -0,0 +1,26 @@
+#ifndef BASE64_H
+#define BASE64_H
+
+#include <QByteArray>
+
+class QIODevice;
+
+// Base64 encoder for embedded images. Three input bytes become four
+// characters through two lookups in a 4096 entry table of character pairs.
+// Lines are wrapped while encoding; lineLength must be a multiple of 4, 0
+// writes a single line. Output goes to memory the caller sized with
+// encodedSize() or to a device in fixed-size pieces.
+class Base64 {
+public:
+  static int encodedSize(int size, int lineLength = 0);
+
+  // returns the number of characters written
+  static int encode(const char* data, int size, char* out, int lineLength = 0);
+  static QByteArray encode(const QByteArray& data, int lineLength = 0);
+  static bool encode(const char* data, qint64 size, QIODevice* device, int lineLength = 0);
+
+private:
+  static char* encodeLine(const uchar* data, int size, char* out);
+};
+
+#endif // BASE64_H
@@ -0,0 +1,72 @@
+#ifndef BLOCKCACHE_H
+#define BLOCKCACHE_H
+
+#include <QVector>
+#include <QTextDocument>
+#include <QTextBlock>
+
+// Per-block state kept aligned with the blocks of a QTextDocument.
+// The owner forwards QTextDocument::contentsChange() to contentsChange():
+// entries of the touched blocks are dropped, all others keep their value
+// even if their block number shifted.
+template <typename T>
+class BlockCache {
+public:
+  struct Entry {
+    Entry() : valid(false) {}
+    T value;
+    bool valid;
+  };
+
+  explicit BlockCache(QTextDocument* document = nullptr) { reset(document); }
+
+  void reset(QTextDocument* document) {
+    mDocument = document;
+    mEntries.clear();
+    mEntries.resize(document ? document->blockCount() : 0);
+  }
+
+  // blocks of the document whose entries were dropped by contentsChange()
+  struct Span {
+    int first;
+    int last;
+  };
+
+  template <typename Dispose>
+  Span contentsChange(int from, int added, Dispose dispose) {
+    if (!mDocument) return Span{ 0, -1 };
+    const int delta = mDocument->blockCount() - mEntries.size();
+    QTextBlock firstBlock = mDocument->findBlock(from);
+    QTextBlock lastBlock = mDocument->findBlock(from + added);
+    if (!firstBlock.isValid()) firstBlock = mDocument->lastBlock();
+    if (!lastBlock.isValid()) lastBlock = mDocument->lastBlock();
+    const int first = firstBlock.blockNumber();
+    const int last = lastBlock.blockNumber();
+    const int oldLast = last - delta;
+    if (oldLast >= mEntries.size() || oldLast < first - 1) {
+      // lost track of the layout, start over
+      for (Entry& entry : mEntries) if (entry.valid) dispose(entry.value);
+      reset(mDocument);
+      return Span{ 0, mEntries.size() - 1 };
+    }
+    for (int i = first; i <= oldLast; ++i) {
+      if (mEntries[i].valid) dispose(mEntries[i].value);
+      mEntries[i] = Entry();
+    }
+    if (delta > 0) mEntries.insert(first, delta, Entry());
+    else if (delta < 0) mEntries.remove(first, -delta);
+    return Span{ first, last };
+  }
+
+  Span contentsChange(int from, int added) { return contentsChange(from, added, [](T&) {}); }
+
+  int size() const { return mEntries.size(); }
+  Entry& entry(int blockNumber) { return mEntries[blockNumber]; }
+  const Entry& entry(int blockNumber) const { return mEntries[blockNumber]; }
+
+private:
+  QTextDocument* mDocument;
+  QVector<Entry> mEntries;
+};
+
+#endif // BLOCKCACHE_H
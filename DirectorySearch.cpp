@@ -0,0 +1,199 @@
+#include "stdafx.h"
+#include "DirectorySearch.h"
+#include <QAtomicInt>
+#include <QByteArrayMatcher>
+#include <QDirIterator>
+#include <QFile>
+#include <QRunnable>
+#include <string.h>
+
+struct DirectorySearch::Job {
+    QString directory;
+    QStringList filters;
+    QByteArray needle;          // utf-8, ascii folded to lower case for case insensitive searches
+    QByteArrayMatcher matcher;
+    bool caseInsensitive;
+    int generation;
+    DirectorySearch* owner;
+    QThreadPool* pool;
+    QAtomicInt canceled;
+    QAtomicInt pending;
+};
+
+namespace {
+
+using Job = DirectorySearch::Job;
+using JobPtr = QSharedPointer<Job>;
+
+const int ChunkSize = 1 << 20;  // bytes searched between two cancellation checks
+const int BatchSize = 256;      // hits per delivery
+const int ContextLimit = 200;   // bytes of a line shown as context
+
+inline uchar foldAscii(uchar c) {
+    return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+// ascii case insensitive search, needle is folded already
+int indexInFolded(const char* data, int length, const QByteArray& needle) {
+    const int n = needle.size();
+    const uchar first = uchar(needle.at(0));
+    const uchar upper = (first >= 'a' && first <= 'z') ? first - ('a' - 'A') : first;
+    for (int i = 0; i + n <= length; ++i) {
+        const uchar c = uchar(data[i]);
+        if (c != first && c != upper) continue;
+        int k = 1;
+        while (k < n && foldAscii(uchar(data[i + k])) == uchar(needle.at(k))) ++k;
+        if (k == n) return i;
+    }
+    return -1;
+}
+
+void finishOne(const JobPtr& job) {
+    if (!job->pending.deref()) {
+        QMetaObject::invokeMethod(job->owner, "complete", Qt::QueuedConnection, Q_ARG(int, job->generation));
+    }
+}
+
+void deliver(const JobPtr& job, DirectorySearch::Hits& hits) {
+    if (hits.isEmpty()) return;
+    QMetaObject::invokeMethod(job->owner, "deliver", Qt::QueuedConnection,
+                              Q_ARG(int, job->generation), Q_ARG(DirectorySearch::Hits, hits));
+    hits.clear();
+}
+
+class FileTask : public QRunnable {
+public:
+    FileTask(const JobPtr& job, const QString& path) : mJob(job), mPath(path) {}
+
+    void run() override {
+        if (!mJob->canceled.load()) search();
+        finishOne(mJob);
+    }
+
+private:
+    void search() {
+        QFile file(mPath);
+        if (!file.open(QIODevice::ReadOnly)) return;
+        const qint64 size = file.size();
+        const int n = mJob->needle.size();
+        if (size < n) return;
+        QByteArray fallback;
+        const char* data = reinterpret_cast<const char*>(file.map(0, size));
+        if (!data) {
+            fallback = file.readAll();
+            data = fallback.constData();
+        }
+
+        DirectorySearch::Hits hits;
+        int line = 1;
+        qint64 counted = 0;     // newlines are counted up to here
+        qint64 lineStart = 0;
+        for (qint64 from = 0; from + n <= size; from += ChunkSize) {
+            if (mJob->canceled.load()) return;
+            const int window = int(qMin<qint64>(ChunkSize + n - 1, size - from));
+            int pos = 0;
+            while (pos < ChunkSize) {
+                const int found = mJob->caseInsensitive
+                    ? indexInFolded(data + from + pos, window - pos, mJob->needle)
+                    : mJob->matcher.indexIn(data + from, window, pos);
+                if (found == -1) break;
+                const int index = mJob->caseInsensitive ? pos + found : found;
+                if (index >= ChunkSize) break;
+                const qint64 offset = from + index;
+                for (const char* p = data + counted;
+                     (p = static_cast<const char*>(memchr(p, '\n', offset - (p - data)))) != nullptr; ++p) {
+                    ++line;
+                    lineStart = p - data + 1;
+                }
+                counted = offset;
+                const char* end = static_cast<const char*>(memchr(data + offset, '\n', size - offset));
+                const qint64 lineEnd = end ? end - data : size;
+                const qint64 contextStart = qMax(lineStart, offset - ContextLimit / 2);
+                const int contextLength = int(qMin<qint64>(lineEnd - contextStart, ContextLimit));
+                hits << DirectorySearch::Hit{ mPath, offset, line,
+                                              QString::fromUtf8(data + contextStart, contextLength) };
+                if (hits.size() >= BatchSize) deliver(mJob, hits);
+                pos = index + n;
+            }
+        }
+        deliver(mJob, hits);
+    }
+
+    JobPtr mJob;
+    QString mPath;
+};
+
+class ScanTask : public QRunnable {
+public:
+    explicit ScanTask(const JobPtr& job) : mJob(job) {}
+
+    void run() override {
+        QDirIterator it(mJob->directory, mJob->filters, QDir::Files | QDir::Readable,
+                        QDirIterator::Subdirectories);
+        while (it.hasNext() && !mJob->canceled.load()) {
+            mJob->pending.ref();
+            mJob->pool->start(new FileTask(mJob, it.next()));
+        }
+        finishOne(mJob);
+    }
+
+private:
+    JobPtr mJob;
+};
+
+}
+
+DirectorySearch::DirectorySearch(QObject* parent)
+    : QObject(parent)
+    , mNameFilters(QStringList() << "*.html" << "*.htm")
+    , mGeneration(0)
+    , mRunning(false)
+{
+    qRegisterMetaType<DirectorySearch::Hits>("DirectorySearch::Hits");
+}
+
+DirectorySearch::~DirectorySearch() {
+    cancel();
+    mPool.waitForDone();
+}
+
+void DirectorySearch::start(const QString& directory, const QString& query, Qt::CaseSensitivity cs) {
+    cancel();
+    if (query.isEmpty()) return;
+    mJob.reset(new Job);
+    mJob->directory = directory;
+    mJob->filters = mNameFilters;
+    mJob->caseInsensitive = cs == Qt::CaseInsensitive;
+    mJob->needle = query.toUtf8();
+    // folded like the file bytes, other characters match as they are
+    if (mJob->caseInsensitive) {
+        for (char& c : mJob->needle) c = char(foldAscii(uchar(c)));
+    }
+    mJob->matcher.setPattern(mJob->needle);
+    mJob->generation = ++mGeneration;
+    mJob->owner = this;
+    mJob->pool = &mPool;
+    mJob->pending.store(1);
+    mRunning = true;
+    mPool.start(new ScanTask(mJob));
+}
+
+void DirectorySearch::cancel() {
+    if (mJob) {
+        mJob->canceled.store(1);
+        mJob.clear();
+    }
+    ++mGeneration;
+    mRunning = false;
+}
+
+void DirectorySearch::deliver(int generation, const DirectorySearch::Hits& hits) {
+    if (generation == mGeneration) emit hitsFound(hits);
+}
+
+void DirectorySearch::complete(int generation) {
+    if (generation != mGeneration) return;
+    mRunning = false;
+    mJob.clear();
+    emit finished();
+}
@@ -0,0 +1,60 @@
+#ifndef DIRECTORYSEARCH_H
+#define DIRECTORYSEARCH_H
+
+#include <QObject>
+#include <QStringList>
+#include <QSharedPointer>
+#include <QThreadPool>
+#include <QVector>
+#include <QMetaType>
+
+// Searches the files below a directory on a thread pool. Files are memory
+// mapped and matched as UTF-8 bytes; only the line around a hit is decoded.
+// Case insensitive searches ignore the case of ASCII letters only, "É"
+// finds "É" but not "é".
+// Hits are delivered on the thread of this object while the search runs,
+// starting a new search cancels the running one.
+class DirectorySearch : public QObject {
+  Q_OBJECT
+public:
+  struct Hit {
+    QString path;
+    qint64 offset;   // byte offset in the file
+    int line;        // 1-based
+    QString context; // the line of the hit
+  };
+  using Hits = QVector<Hit>;
+
+  explicit DirectorySearch(QObject* parent = nullptr);
+  ~DirectorySearch();
+
+  void setNameFilters(const QStringList& filters) { mNameFilters = filters; }
+  QStringList nameFilters() const { return mNameFilters; }
+
+  void start(const QString& directory, const QString& query, Qt::CaseSensitivity cs = Qt::CaseInsensitive);
+  void cancel();
+  bool isRunning() const { return mRunning; }
+
+signals:
+  void hitsFound(const DirectorySearch::Hits& hits);
+  void finished();
+
+private slots:
+  void deliver(int generation, const DirectorySearch::Hits& hits);
+  void complete(int generation);
+
+public:
+  struct Job;
+
+private:
+  QThreadPool mPool;
+  QStringList mNameFilters;
+  QSharedPointer<Job> mJob;
+  int mGeneration;
+  bool mRunning;
+};
+
+Q_DECLARE_METATYPE(DirectorySearch::Hit)
+Q_DECLARE_METATYPE(DirectorySearch::Hits)
+
+#endif // DIRECTORYSEARCH_H
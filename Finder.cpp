@@ -2,9 +2,11 @@
 #include "Finder.h"
 #include <QDebug>
 #include "Global.h"
+#include "Timing.h"
 
 Finder::Finder(const QString& text, const QString& target)
     : mText(text)
+    , mHasFounded(false)
 {
     if (!target.isEmpty()) find(target);
 }
@@ -14,15 +16,18 @@ void Finder::setText(const QString& text) {
 }
 
 int Finder::find(const QString& target) {
+    Timing::Scope timing("find", mText.size());
+    mSymbolPositions.clear();
     int index = 0;
     while ((index = mText.indexOf(target, index)) != -1) mSymbolPositions << index++;
-    return mSymbolPositions.isEmpty() ? Search::NotFound : mSymbolPositions.back();
+    mHasFounded = !mSymbolPositions.isEmpty();
+    return mHasFounded ? mSymbolPositions.back() : Search::NotFound;
 }
 
 bool Finder::hasFounded() const {
-    return !mSymbolPositions.isEmpty();
+    return mHasFounded;
 }
 
-Finder::SymbolPositions Finder::symbolPositions() const {
+const Finder::SymbolPositions& Finder::symbolPositions() const {
     return mSymbolPositions;
 }
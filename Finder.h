@@ -12,7 +12,7 @@ public:
   int find(const QString& target);
   bool hasFounded() const;
 public:
-  SymbolPositions symbolPositions() const;
+  const SymbolPositions& symbolPositions() const;
 private:
   QString mText;
   SymbolPositions mSymbolPositions;
@@ -0,0 +1,75 @@
+#include "stdafx.h"
+#include "FormatRemover.h"
+#include <QTextBlock>
+#include <QTextCursor>
+#include <QTextDocument>
+#include <QTextList>
+
+FormatRemover::FormatRemover(QTextDocument* document)
+    : mDocument(document) {
+}
+
+int FormatRemover::removeAll(Options options) {
+    return remove(0, mDocument->characterCount() - 1, options);
+}
+
+int FormatRemover::remove(const QTextCursor& selection, Options options) {
+    if (!selection.hasSelection()) return 0;
+    return remove(selection.selectionStart(), selection.selectionEnd(), options);
+}
+
+int FormatRemover::remove(int from, int to, Options options) {
+    const QTextCharFormat plain;
+    QVector<Run> runs;
+    QVector<int> blocks;   // positions of blocks whose block format changes
+
+    const QTextBlock last = mDocument->findBlock(to);
+    for (QTextBlock block = mDocument->findBlock(from); block.isValid(); block = block.next()) {
+        QTextBlockFormat reset;
+        if ((options & KeepLists) && block.textList()) {
+            reset.setObjectIndex(block.blockFormat().objectIndex());
+        }
+        if (block.blockFormat() != reset || block.charFormat() != plain) {
+            blocks << block.position();
+        }
+        for (QTextBlock::iterator it = block.begin(); !it.atEnd(); ++it) {
+            const QTextFragment fragment = it.fragment();
+            const int start = qMax(from, fragment.position());
+            const int end = qMin(to, fragment.position() + fragment.length());
+            if (start >= end) continue;
+            const bool image = fragment.charFormat().isImageFormat();
+            if (image && (options & KeepImages)) continue;
+            if (!image && fragment.charFormat() == plain) continue;
+            runs << Run{ start, end - start, image };
+        }
+        if (block == last) break;
+    }
+    if (runs.isEmpty() && blocks.isEmpty()) return 0;
+
+    QTextCursor cursor(mDocument);
+    cursor.beginEditBlock();
+    // block formats first, they do not move any position
+    for (int position : blocks) {
+        const QTextBlock block = mDocument->findBlock(position);
+        QTextBlockFormat reset;
+        if ((options & KeepLists) && block.textList()) {
+            reset.setObjectIndex(block.blockFormat().objectIndex());
+        }
+        cursor.setPosition(block.position());
+        cursor.setBlockFormat(reset);
+        cursor.setBlockCharFormat(plain);
+    }
+    // backwards, removed images do not move the runs still to do
+    for (int i = runs.size() - 1; i >= 0; --i) {
+        const Run& run = runs.at(i);
+        cursor.setPosition(run.start);
+        cursor.setPosition(run.start + run.length, QTextCursor::KeepAnchor);
+        if (run.image) {
+            cursor.removeSelectedText();
+        } else {
+            cursor.setCharFormat(plain);
+        }
+    }
+    cursor.endEditBlock();
+    return runs.size() + blocks.size();
+}
@@ -0,0 +1,43 @@
+#ifndef FORMATREMOVER_H
+#define FORMATREMOVER_H
+#include <QFlags>
+#include <QVector>
+
+class QTextDocument;
+class QTextCursor;
+
+// Resets character and block formats in place through QTextCursor inside a
+// single edit block, so the change is one undo step and only the runs that
+// carry a format are touched. Text, tables and the undo history stay.
+class FormatRemover {
+public:
+  enum Option {
+      NoOptions = 0x0,
+      KeepImages = 0x1,   // otherwise images are removed like in plain text
+      KeepLists = 0x2     // blocks stay in their lists
+  };
+  Q_DECLARE_FLAGS(Options, Option)
+
+  explicit FormatRemover(QTextDocument* document);
+
+  // the whole document, returns the number of runs and blocks changed
+  int removeAll(Options options = NoOptions);
+  // the selection of cursor, the blocks it touches get the default block format
+  int remove(const QTextCursor& selection, Options options = NoOptions);
+
+private:
+  struct Run {
+      int start;
+      int length;
+      bool image;
+  };
+
+  int remove(int from, int to, Options options);
+
+private:
+  QTextDocument* mDocument;
+};
+
+Q_DECLARE_OPERATORS_FOR_FLAGS(FormatRemover::Options)
+
+#endif // FORMATREMOVER_H
@@ -1,93 +1,351 @@
 #include "stdafx.h"
 #include "HtmlHighlighter.h"
+#include "HtmlLexer.h"
+#include "Timing.h"
+#include <QTimer>
+#include <QThread>
+#include <QMap>
+#include <QTextBlock>
+
+namespace {
+// a batch for the worker ends at whichever limit comes first
+const int MaxBatchBlocks = 512;
+const int MaxBatchChars = 256 * 1024;
+}
+
+static_assert(int(HtmlHighlighter::Entity) == int(HtmlLexer::Entity)
+              && int(HtmlHighlighter::Tag) == int(HtmlLexer::Tag)
+              && int(HtmlHighlighter::Comment) == int(HtmlLexer::Comment),
+              "HtmlLexer reports HtmlHighlighter constructs");
+
+namespace {
+
+typedef QMap<QString, HtmlHighlighter::Theme> Themes;
+
+Themes& themes() {
+    static Themes themes;
+    if (themes.isEmpty()) {
+        HtmlHighlighter::Theme light;
+        light.formats[HtmlHighlighter::Entity].setForeground(QColor(0, 128, 0));
+        light.formats[HtmlHighlighter::Entity].setFontWeight(QFont::Bold);
+        light.formats[HtmlHighlighter::Tag].setForeground(QColor(192, 16, 112));
+        light.formats[HtmlHighlighter::Tag].setFontWeight(QFont::Bold);
+        light.formats[HtmlHighlighter::Comment].setForeground(QColor(128, 10, 74));
+        light.formats[HtmlHighlighter::Comment].setFontItalic(true);
+        themes.insert("Default", light);
+
+        HtmlHighlighter::Theme dark;
+        dark.formats[HtmlHighlighter::Entity].setForeground(QColor(152, 195, 121));
+        dark.formats[HtmlHighlighter::Entity].setFontWeight(QFont::Bold);
+        dark.formats[HtmlHighlighter::Tag].setForeground(QColor(224, 108, 117));
+        dark.formats[HtmlHighlighter::Tag].setFontWeight(QFont::Bold);
+        dark.formats[HtmlHighlighter::Comment].setForeground(QColor(128, 128, 128));
+        dark.formats[HtmlHighlighter::Comment].setFontItalic(true);
+        themes.insert("Dark", dark);
+
+        themes.insert("Plain", HtmlHighlighter::Theme());
+    }
+    return themes;
+}
+
+}
 
 HtmlHighlighter::HtmlHighlighter(QTextDocument* document)
 : QSyntaxHighlighter(document)
 {
-  QTextCharFormat entityFormat;
-  entityFormat.setForeground(QColor(0, 128, 0));
-  entityFormat.setFontWeight(QFont::Bold);
-  setFormatFor(Entity, entityFormat);
+  m_sweepTimer = new QTimer(this);
+  m_sweepTimer->setSingleShot(true);
+  connect(m_sweepTimer, &QTimer::timeout, this, &HtmlHighlighter::continueHighlighting);
+  m_lexTimer = new QTimer(this);
+  m_lexTimer->setSingleShot(true);
+  connect(m_lexTimer, &QTimer::timeout, this, &HtmlHighlighter::requestLexing);
+  m_refreshTimer = new QTimer(this);
+  m_refreshTimer->setSingleShot(true);
+  connect(m_refreshTimer, &QTimer::timeout, this, &HtmlHighlighter::refresh);
 
-  QTextCharFormat tagFormat;
-  tagFormat.setForeground(QColor(192, 16, 112));
-  tagFormat.setFontWeight(QFont::Bold);
-  setFormatFor(Tag, tagFormat);
+  // the base class already queued a pass over the document,
+  // settings changed before it runs need no pass of their own
+  QTimer::singleShot(0, this, [this]() { m_initialPass = false; });
 
-  QTextCharFormat commentFormat;
-  commentFormat.setForeground(QColor(128, 10, 74));
-  commentFormat.setFontItalic(true);
-  setFormatFor(Comment, commentFormat);
+  const Theme initial = theme("Default");
+  for (int i = 0; i <= LastConstruct; ++i) m_formats[i] = initial.formats[i];
+  m_themeName = "Default";
+}
+
+HtmlHighlighter::~HtmlHighlighter() {
+    if (m_thread) {
+        m_thread->quit();
+        m_thread->wait();
+    }
 }
 
 void HtmlHighlighter::setFormatFor(Construct construct, const QTextCharFormat& format) {
+    if (m_formats[construct] == format) return;
     m_formats[construct] = format;
-    rehighlight();
+    m_themeName.clear();
+    m_formatsChanged = true;
+    if (!m_formatUpdates) endFormatUpdate();
+}
+
+void HtmlHighlighter::endFormatUpdate() {
+    if (m_formatUpdates > 0) --m_formatUpdates;
+    if (m_formatUpdates || !m_formatsChanged) return;
+    m_formatsChanged = false;
+    scheduleRefresh();
+}
+
+void HtmlHighlighter::setTheme(const Theme& theme) {
+    beginFormatUpdate();
+    for (int i = 0; i <= LastConstruct; ++i) setFormatFor(Construct(i), theme.formats[i]);
+    endFormatUpdate();
+}
+
+bool HtmlHighlighter::setTheme(const QString& name) {
+    if (!themes().contains(name)) return false;
+    setTheme(themes().value(name));
+    m_themeName = name;
+    return true;
+}
+
+QStringList HtmlHighlighter::themeNames() {
+    return themes().keys();
+}
+
+HtmlHighlighter::Theme HtmlHighlighter::theme(const QString& name) {
+    return themes().value(name, themes().value("Default"));
+}
+
+void HtmlHighlighter::registerTheme(const QString& name, const Theme& theme) {
+    themes().insert(name, theme);
+}
+
+void HtmlHighlighter::setMode(Mode mode) {
+    if (mode == m_mode) return;
+    m_mode = mode;
+    m_sweepTimer->stop();
+    m_sweep = NoBlock;
+    if (m_mode == Threaded) startWorker();
+    scheduleRefresh();
+}
+
+void HtmlHighlighter::scheduleRefresh() {
+    if (m_initialPass || !document()) return;
+    if (!m_refreshTimer->isActive()) m_refreshTimer->start(0);
+}
+
+void HtmlHighlighter::refresh() {
+    if (!document()) return;
+    if (m_mode != Progressive) {
+        rehighlight();
+        return;
+    }
+    // what is on screen now, the sweep takes the rest
+    for (QTextBlock block = document()->begin(); block.isValid(); block = block.next()) {
+        block.setUserState(Pending);
+    }
+    scheduleSweep(0);
+    setVisibleBlocks(m_firstVisible, m_lastVisible);
+}
+
+void HtmlHighlighter::startWorker() {
+    if (m_thread) return;
+    qRegisterMetaType<HtmlLexBatch>();
+    qRegisterMetaType<HtmlLexResult>();
+    m_thread = new QThread(this);
+    HtmlLexWorker *worker = new HtmlLexWorker;
+    worker->moveToThread(m_thread);
+    connect(m_thread, &QThread::finished, worker, &QObject::deleteLater);
+    connect(this, &HtmlHighlighter::lexRequested, worker, &HtmlLexWorker::lex);
+    connect(worker, &HtmlLexWorker::lexed, this, &HtmlHighlighter::applyLexed);
+    m_thread->start();
+}
+
+void HtmlHighlighter::markDirty(int blockNumber) {
+    if (m_lexing) {
+        m_lateFrom = qMin(m_lateFrom, blockNumber);
+        m_lateTo = qMax(m_lateTo, blockNumber);
+        return;
+    }
+    if (m_dirtyFrom == NoBlock) m_dirtyBlockCount = document()->blockCount();
+    m_dirtyFrom = qMin(m_dirtyFrom, blockNumber);
+    m_dirtyTo = qMax(m_dirtyTo, blockNumber);
+    if (!m_lexTimer->isActive()) m_lexTimer->start(0);
+}
+
+void HtmlHighlighter::requestLexing() {
+    if (m_lexing || m_dirtyFrom == NoBlock || !document()) return;
+    // follow blocks inserted or removed since the range was recorded
+    const int count = document()->blockCount();
+    m_dirtyTo = qMax(m_dirtyFrom, m_dirtyTo + count - m_dirtyBlockCount);
+    m_dirtyBlockCount = count;
+
+    QTextBlock block = document()->findBlockByNumber(m_dirtyFrom);
+    if (!block.isValid()) {
+        m_dirtyFrom = NoBlock;
+        m_dirtyTo = -1;
+        return;
+    }
+    HtmlLexBatch batch;
+    batch.startState = block.previous().isValid() ? block.previous().userState() : NormalState;
+    batch.dirtyTo = m_dirtyTo;
+    int chars = 0;
+    for (int number = m_dirtyFrom; block.isValid() && batch.items.size() < MaxBatchBlocks && chars < MaxBatchChars;
+         block = block.next(), ++number) {
+        const HtmlBlockData *data = static_cast<const HtmlBlockData *>(block.userData());
+        HtmlLexBatch::Item item;
+        item.number = number;
+        item.revision = block.revision();
+        item.text = block.text();
+        item.known = data && data->revision == item.revision;
+        item.knownStart = item.known ? data->startState : NormalState;
+        item.knownEnd = item.known ? data->endState : NormalState;
+        chars += item.text.length();
+        batch.items << item;
+    }
+    m_lexing = true;
+    m_batchRevision = document()->revision();
+    m_batchBlockCount = count;
+    m_batchFrom = m_dirtyFrom;
+    m_batchTo = m_dirtyTo;
+    emit lexRequested(batch);
+}
+
+void HtmlHighlighter::applyLexed(const HtmlLexResult& result) {
+    m_lexing = false;
+    if (!document()) return;
+    // blocks share revisions, e.g. all of them after setPlainText(), so after
+    // any edit a block number and revision may name a neighbour: the batch
+    // is lexed again
+    const bool current = document()->revision() == m_batchRevision
+        && document()->blockCount() == m_batchBlockCount;
+    if (!current) {
+        if (m_dirtyFrom == NoBlock) m_dirtyBlockCount = m_batchBlockCount;
+        m_dirtyFrom = qMin(m_dirtyFrom, m_batchFrom);
+        m_dirtyTo = qMax(m_dirtyTo, m_batchTo);
+    } else if (result.stable || result.next >= document()->blockCount()) {
+        m_dirtyFrom = NoBlock;
+        m_dirtyTo = -1;
+    } else {
+        m_dirtyFrom = result.next;
+    }
+    if (m_lateFrom != NoBlock) {
+        if (m_dirtyFrom == NoBlock) m_dirtyBlockCount = document()->blockCount();
+        m_dirtyFrom = qMin(m_dirtyFrom, m_lateFrom);
+        m_dirtyTo = qMax(m_dirtyTo, m_lateTo);
+        m_lateFrom = NoBlock;
+        m_lateTo = -1;
+    }
+
+    for (const HtmlLexResult::Block &lexed : current ? result.blocks : QVector<HtmlLexResult::Block>()) {
+        QTextBlock block = document()->findBlockByNumber(lexed.number);
+        // edited meanwhile: the edit queued the block again
+        if (!block.isValid() || block.revision() != lexed.revision) continue;
+        HtmlBlockData *data = static_cast<HtmlBlockData *>(block.userData());
+        if (!data) {
+            data = new HtmlBlockData;
+            block.setUserData(data);
+        }
+        data->revision = lexed.revision;
+        data->startState = lexed.startState;
+        data->endState = lexed.endState;
+        data->runs = lexed.runs;
+        rehighlightBlock(block);
+    }
+
+    if (m_dirtyFrom != NoBlock) {
+        m_lexTimer->start(0);
+    } else if (!m_lexing) {
+        emit highlightingFinished();
+    }
+}
+
+void HtmlHighlighter::highlightFromCache(const QString& text) {
+    const QTextBlock block = currentBlock();
+    const HtmlBlockData *data = static_cast<const HtmlBlockData *>(currentBlockUserData());
+    if (data) {
+        // stale runs are shown until the worker catches up
+        const int length = text.length();
+        for (const HtmlLexRun &run : data->runs) {
+            if (run.start >= length) break;
+            setFormat(run.start, qMin(run.length, length - run.start), m_formats[run.construct]);
+        }
+        if (data->revision == block.revision() && data->startState == previousBlockState()) {
+            setCurrentBlockState(data->endState);
+            return;
+        }
+    }
+    markDirty(block.blockNumber());
+}
+
+void HtmlHighlighter::setVisibleBlocks(int first, int last) {
+    m_firstVisible = first;
+    m_lastVisible = last;
+    if (m_sweep == NoBlock || !document()) return;
+    for (QTextBlock block = document()->findBlockByNumber(qMax(first, m_sweep));
+         block.isValid() && block.blockNumber() <= last; block = block.next()) {
+        if (block.userState() == Pending) rehighlightBlock(block);
+    }
+}
+
+bool HtmlHighlighter::deferBlock(int blockNumber) {
+    if (m_mode != Progressive) return false;
+    if (blockNumber >= m_firstVisible && blockNumber <= m_lastVisible) return false;
+    if (m_sweepBlock != -1) return blockNumber != m_sweepBlock;
+    if (!m_budget.isValid()) {
+        m_budget.start();
+        QTimer::singleShot(0, this, [this]() { m_budget.invalidate(); });
+    }
+    return m_budget.elapsed() >= m_sliceMsec;
+}
+
+void HtmlHighlighter::scheduleSweep(int blockNumber) {
+    m_sweep = qMin(m_sweep, blockNumber);
+    if (!m_sweepTimer->isActive()) m_sweepTimer->start(0);
+}
+
+void HtmlHighlighter::continueHighlighting() {
+    QElapsedTimer clock;
+    clock.start();
+    QTextBlock block = document()->findBlockByNumber(m_sweep);
+    for (; block.isValid(); block = block.next()) {
+        if (block.userState() != Pending) continue;
+        if (clock.elapsed() >= m_sliceMsec) break;
+        // one block per step: the following ones stay pending instead of
+        // being pulled in by the state chain, the sweep reaches them next
+        m_sweepBlock = block.blockNumber();
+        rehighlightBlock(block);
+        m_sweepBlock = -1;
+    }
+    if (block.isValid()) {
+        m_sweep = block.blockNumber();
+        m_sweepTimer->start(0);
+    } else {
+        m_sweep = NoBlock;
+        emit highlightingFinished();
+    }
 }
 
 void HtmlHighlighter::highlightBlock(const QString& text)
 {
-    int state = previousBlockState();
-    int len = text.length();
-    int start = 0;
-    int pos = 0;
-    while (pos < len) {
-        switch (state) {
-        case NormalState:
-        default:
-            while (pos < len) {
-                QChar ch = text.at(pos);
-                if (ch == '<') {
-                    if (text.mid(pos, 4) == "<!--") {
-                        state = InComment;
-                    } else {
-                        state = InTag;
-                    }
-                    break;
-                } else if (ch == '&') {
-                    start = pos;
-                    while (pos < len && text.at(pos++) != ';') {
-                      setFormat(start, pos - start, m_formats[Entity]);
-                    }
-                } else {
-                    ++pos;
-                }
-            }
-            break;
-            case InComment:
-            start = pos;
-            while (pos < len) {
-                if (text.mid(pos, 3) == "-->") {
-                    pos += 3;
-                    state = NormalState;
-                    break;
-                } else {
-                    ++pos;
-                }
-            }
-            setFormat(start, pos - start,
-                      m_formats[Comment]);
-            break;
-            case InTag:
-            QChar quote = QChar::Null;
-            start = pos;
-            while (pos < len) {
-                QChar ch = text.at(pos);
-                if (quote.isNull()) {
-                    if (ch == '\"' || ch == '"') {
-                        quote = ch;
-                    } else if (ch == '>') {
-                        ++pos;
-                        state = NormalState;
-                        break;
-                    }
-                } else if (ch == quote) {
-                    quote = QChar::Null;
-                }
-                ++pos;
-            }
-            setFormat(start, pos - start, m_formats[Tag]);
-        }
+    Timing::Scope timing("highlightBlock", text.length());
+    if (m_mode == Threaded) {
+        highlightFromCache(text);
+        return;
+    }
+    const int blockNumber = currentBlock().blockNumber();
+    if (deferBlock(blockNumber)) {
+        setCurrentBlockState(Pending);
+        scheduleSweep(blockNumber);
+        return;
+    }
+    int previous = previousBlockState();
+    if (previous == Pending) {
+        // lexed ahead of the sweep, corrected when the sweep gets here
+        previous = NormalState;
     }
-     setCurrentBlockState(state);
+    const int state = HtmlLexer::lex(text, previous,
+        [this](int start, int length, HtmlLexer::Construct construct) {
+            setFormat(start, length, m_formats[construct]);
+        });
+    setCurrentBlockState(state);
 }
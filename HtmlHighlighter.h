@@ -2,6 +2,13 @@
 #define HTMLHIGHLIGHTER_H
 
 #include <QSyntaxHighlighter>
+#include <QElapsedTimer>
+#include <QStringList>
+#include <climits>
+#include "HtmlLexWorker.h"
+
+class QTimer;
+class QThread;
 
 class HtmlHighlighter : public QSyntaxHighlighter {
     Q_OBJECT
@@ -13,23 +20,99 @@ public:
       LastConstruct = Comment
   };
 
+  enum Mode {
+      Synchronous,   // every block is lexed as soon as it changes
+      Progressive,   // visible blocks first, the rest in time slices
+      Threaded       // lexed on a worker thread, only the runs are applied here
+  };
+
+  // a named set of formats, one per construct
+  struct Theme {
+      QTextCharFormat formats[LastConstruct + 1];
+  };
+
   HtmlHighlighter(QTextDocument *document);
+  ~HtmlHighlighter();
+
+  void setMode(Mode mode);
+  Mode mode() const { return m_mode; }
+  void setVisibleBlocks(int first, int last);
+  void setSliceDuration(int msec) { m_sliceMsec = msec; }
+  bool isHighlighting() const { return m_sweep != NoBlock || m_dirtyFrom != NoBlock || m_lexing; }
 
   void setFormatFor(Construct construct, const QTextCharFormat& format);
   QTextCharFormat formatFor(Construct construct) const
       { return m_formats[construct]; }
 
+  // format changes between these calls cost a single rehighlight
+  void beginFormatUpdate() { ++m_formatUpdates; }
+  void endFormatUpdate();
+
+  void setTheme(const Theme& theme);
+  bool setTheme(const QString& name);
+  QString themeName() const { return m_themeName; }
+
+  static QStringList themeNames();
+  static Theme theme(const QString& name);
+  static void registerTheme(const QString& name, const Theme& theme);
+
+signals:
+  void highlightingFinished();
+  void lexRequested(const HtmlLexBatch& batch);
+
 protected:
   enum State {
       NormalState = -1,
       InComment,
-      InTag
+      InTag,
+      Pending = -2   // not lexed yet, waits for the sweep
   };
 
   void highlightBlock(const QString& text);
 
+private slots:
+  void refresh();
+  void continueHighlighting();
+  void requestLexing();
+  void applyLexed(const HtmlLexResult& result);
+
 private:
+  enum { NoBlock = INT_MAX };
+
+  void scheduleRefresh();
+  bool deferBlock(int blockNumber);
+  void scheduleSweep(int blockNumber);
+  void startWorker();
+  void highlightFromCache(const QString& text);
+  void markDirty(int blockNumber);
+
   QTextCharFormat m_formats[LastConstruct + 1];
+  QString m_themeName;
+  int m_formatUpdates = 0;
+  bool m_formatsChanged = false;
+  bool m_initialPass = true;    // QSyntaxHighlighter has a full pass queued
+  QTimer *m_refreshTimer = nullptr;
+  Mode m_mode = Synchronous;
+  int m_firstVisible = 0;
+  int m_lastVisible = 100;
+  int m_sliceMsec = 16;
+  int m_sweep = NoBlock;        // lowest block that may be pending
+  int m_sweepBlock = -1;        // block lexed by the running sweep step
+  QTimer *m_sweepTimer = nullptr;
+  QElapsedTimer m_budget;       // time spent highlighting in this event loop turn
+
+  QThread *m_thread = nullptr;
+  QTimer *m_lexTimer = nullptr;
+  bool m_lexing = false;        // a batch is on the worker
+  int m_batchRevision = -1;     // document revision, block count and range of that batch;
+  int m_batchBlockCount = 0;    // its result is only valid for the same document
+  int m_batchFrom = NoBlock;
+  int m_batchTo = -1;
+  int m_dirtyFrom = NoBlock;    // blocks waiting for the worker
+  int m_dirtyTo = -1;
+  int m_dirtyBlockCount = 0;    // block count when the range was recorded
+  int m_lateFrom = NoBlock;     // blocks marked while a batch was on the worker
+  int m_lateTo = -1;
 };
 
 #endif // HTMLHIGHLIGHTER_H
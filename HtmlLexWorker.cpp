@@ -0,0 +1,31 @@
+#include "stdafx.h"
+#include "HtmlLexWorker.h"
+#include "HtmlLexer.h"
+
+void HtmlLexWorker::lex(const HtmlLexBatch &batch)
+{
+    HtmlLexResult result;
+    int state = batch.startState;
+    for (const HtmlLexBatch::Item &item : batch.items) {
+        result.next = item.number + 1;
+        if (item.known && item.knownStart == state) {
+            if (item.number > batch.dirtyTo) {
+                result.stable = true;
+                break;
+            }
+            state = item.knownEnd;
+            continue;
+        }
+        HtmlLexResult::Block block;
+        block.number = item.number;
+        block.revision = item.revision;
+        block.startState = state;
+        block.endState = HtmlLexer::lex(item.text, state,
+            [&block](int start, int length, HtmlLexer::Construct construct) {
+                block.runs.append(HtmlLexRun{ start, length, construct });
+            });
+        state = block.endState;
+        result.blocks.append(block);
+    }
+    emit lexed(result);
+}
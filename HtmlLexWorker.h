@@ -0,0 +1,69 @@
+#ifndef HTMLLEXWORKER_H
+#define HTMLLEXWORKER_H
+
+#include <QObject>
+#include <QMetaType>
+#include <QString>
+#include <QVector>
+#include <QTextBlockUserData>
+
+struct HtmlLexRun {
+    int start;
+    int length;
+    int construct;
+};
+
+// lexing result kept on a block of the highlighted document
+class HtmlBlockData : public QTextBlockUserData {
+public:
+    int revision = -1;
+    int startState = -1;
+    int endState = -1;
+    QVector<HtmlLexRun> runs;
+};
+
+// snapshot of consecutive blocks sent to the worker
+struct HtmlLexBatch {
+    struct Item {
+        int number;
+        int revision;
+        QString text;
+        bool known;       // block has a result for this revision
+        int knownStart;
+        int knownEnd;
+    };
+    int startState = -1;
+    int dirtyTo = -1;     // past this block a known, matching block ends the work
+    QVector<Item> items;
+};
+
+struct HtmlLexResult {
+    struct Block {
+        int number;
+        int revision;
+        int startState;
+        int endState;
+        QVector<HtmlLexRun> runs;
+    };
+    QVector<Block> blocks;
+    int next = -1;        // first block not looked at
+    bool stable = false;  // the state chain met a known block, nothing left to do
+};
+
+Q_DECLARE_METATYPE(HtmlLexBatch)
+Q_DECLARE_METATYPE(HtmlLexResult)
+
+// Lexes block snapshots for HtmlHighlighter's Threaded mode, lives on its own thread.
+class HtmlLexWorker : public QObject {
+    Q_OBJECT
+public:
+    using QObject::QObject;
+
+public slots:
+    void lex(const HtmlLexBatch &batch);
+
+signals:
+    void lexed(const HtmlLexResult &result);
+};
+
+#endif // HTMLLEXWORKER_H
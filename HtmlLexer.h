@@ -0,0 +1,156 @@
+#ifndef HTMLLEXER_H
+#define HTMLLEXER_H
+
+#include <QString>
+#include <QtAlgorithms>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define HTMLLEXER_SSE2
+#include <emmintrin.h>
+#endif
+
+// The scanner behind HtmlHighlighter. It jumps between the characters that
+// can change its state and reports format runs to a sink,
+// void sink(int start, int length, Construct construct), merging adjacent
+// runs of the same construct. Nothing is allocated.
+class HtmlLexer {
+public:
+  // same values as HtmlHighlighter::Construct and HtmlHighlighter::State
+  enum Construct {
+      Entity,
+      Tag,
+      Comment
+  };
+  enum State {
+      NormalState = -1,
+      InComment,
+      InTag
+  };
+
+  template <typename Sink>
+  static int lex(const QChar* text, int length, int state, Sink sink);
+  template <typename Sink>
+  static int lex(const QString& text, int state, Sink sink)
+      { return lex(text.constData(), text.length(), state, sink); }
+
+  // first position at or after pos holding one of the characters, length if none
+  template <int N>
+  static int indexOfAny(const ushort* s, int pos, int length, const ushort (&chars)[N]);
+
+private:
+  template <typename Sink>
+  class Runs {
+  public:
+    explicit Runs(Sink& sink) : mSink(sink), mStart(0), mLength(0), mConstruct(Entity) {}
+    ~Runs() { flush(); }
+    void add(int start, int length, Construct construct) {
+        if (length <= 0) return;
+        if (mLength && construct == mConstruct && start == mStart + mLength) {
+            mLength += length;
+            return;
+        }
+        flush();
+        mStart = start;
+        mLength = length;
+        mConstruct = construct;
+    }
+  private:
+    void flush() { if (mLength) mSink(mStart, mLength, mConstruct); mLength = 0; }
+    Sink& mSink;
+    int mStart;
+    int mLength;
+    Construct mConstruct;
+  };
+};
+
+template <int N>
+inline int HtmlLexer::indexOfAny(const ushort* s, int pos, int length, const ushort (&chars)[N]) {
+#ifdef HTMLLEXER_SSE2
+    __m128i needles[N];
+    for (int i = 0; i < N; ++i) needles[i] = _mm_set1_epi16(short(chars[i]));
+    for (; pos + 8 <= length; pos += 8) {
+        const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s + pos));
+        __m128i hits = _mm_cmpeq_epi16(chunk, needles[0]);
+        for (int i = 1; i < N; ++i) hits = _mm_or_si128(hits, _mm_cmpeq_epi16(chunk, needles[i]));
+        const uint mask = uint(_mm_movemask_epi8(hits));
+        if (mask) return pos + int(qCountTrailingZeroBits(mask)) / 2;
+    }
+#endif
+    for (; pos < length; ++pos) {
+        for (int i = 0; i < N; ++i) if (s[pos] == chars[i]) return pos;
+    }
+    return length;
+}
+
+template <typename Sink>
+int HtmlLexer::lex(const QChar* text, int length, int state, Sink sink) {
+    static const ushort normalStops[] = { '<', '&' };
+    static const ushort entityStops[] = { ';', '<', ' ', '\t' };
+    static const ushort commentStops[] = { '-' };
+    static const ushort tagStops[] = { '>', '"', '\'' };
+    const ushort* s = reinterpret_cast<const ushort*>(text);
+    Runs<Sink> runs(sink);
+    int pos = 0;
+    while (pos < length) {
+        switch (state) {
+        case InComment: {
+            const int start = pos;
+            if (pos + 3 < length && s[pos] == '<' && s[pos + 1] == '!' && s[pos + 2] == '-' && s[pos + 3] == '-') {
+                pos += 4;
+            }
+            while ((pos = indexOfAny(s, pos, length, commentStops)) < length) {
+                if (pos + 2 < length && s[pos + 1] == '-' && s[pos + 2] == '>') {
+                    pos += 3;
+                    state = NormalState;
+                    break;
+                }
+                ++pos;
+            }
+            runs.add(start, pos - start, Comment);
+            break;
+        }
+        case InTag: {
+            const int start = pos;
+            ushort quote = 0;
+            while (pos < length) {
+                if (quote) {
+                    const ushort closing[] = { quote };
+                    pos = indexOfAny(s, pos, length, closing);
+                    if (pos < length) {
+                        ++pos;
+                        quote = 0;
+                    }
+                    continue;
+                }
+                pos = indexOfAny(s, pos, length, tagStops);
+                if (pos == length) break;
+                if (s[pos++] == '>') {
+                    state = NormalState;
+                    break;
+                }
+                quote = s[pos - 1];
+            }
+            runs.add(start, pos - start, Tag);
+            break;
+        }
+        case NormalState:
+        default:
+            state = NormalState;
+            pos = indexOfAny(s, pos, length, normalStops);
+            if (pos == length) break;
+            if (s[pos] == '<') {
+                state = (pos + 3 < length && s[pos + 1] == '!' && s[pos + 2] == '-' && s[pos + 3] == '-')
+                    ? InComment : InTag;
+            } else {
+                const int start = pos;
+                pos = indexOfAny(s, pos + 1, length, entityStops);
+                if (pos < length && s[pos] == ';') ++pos;
+                runs.add(start, pos - start, Entity);
+            }
+            break;
+        }
+    }
+    return state;
+}
+
+#endif // HTMLLEXER_H
@@ -0,0 +1,187 @@
+#include "stdafx.h"
+#include "HtmlLoader.h"
+#include "ImageStore.h"
+#include <QIODevice>
+#include <QTextCodec>
+#include <QTextCursor>
+#include <QTextDocument>
+#include <QTextDocumentFragment>
+#include <QTimer>
+
+namespace {
+
+// a chunk is cut only outside of these, they may span many blocks
+bool isContainer(const QStringRef& tag) {
+  static const char* const tags[] = { "table", "ul", "ol", "dl", "pre", "blockquote", "div", "script", "style" };
+  for (const char* name : tags) {
+    if (tag.compare(QLatin1String(name), Qt::CaseInsensitive) == 0) return true;
+  }
+  return false;
+}
+
+bool endsBlock(const QStringRef& tag) {
+  static const char* const tags[] = { "p", "h1", "h2", "h3", "h4", "h5", "h6", "hr" };
+  for (const char* name : tags) {
+    if (tag.compare(QLatin1String(name), Qt::CaseInsensitive) == 0) return true;
+  }
+  return isContainer(tag);
+}
+
+// the first block of a fragment is merged into the block at the cursor and
+// loses its block format, an empty block in front of it takes that place
+const char* const MergedBlock = "<p style=\"-qt-paragraph-type:empty;\"><br /></p>";
+
+}
+
+HtmlLoader::HtmlLoader(QTextDocument* document, QObject* parent)
+  : QObject(parent), mDocument(document) {
+  mTimer = new QTimer(this);
+  mTimer->setSingleShot(true);
+  connect(mTimer, &QTimer::timeout, this, &HtmlLoader::loadChunk);
+}
+
+HtmlLoader::~HtmlLoader() {
+  if (isLoading()) stop(false);
+}
+
+void HtmlLoader::start(QIODevice* device) {
+  if (isLoading()) stop(false);
+  mDevice = device;
+  mDone = 0;
+  mPending.clear();
+  mHead.clear();
+  mHeadRead = false;
+  mFirst = true;
+  mScanned = 0;
+  mDepth = 0;
+  mChannelFinished = false;
+  if (device->isSequential()) {
+    // no polling while nothing has arrived
+    connect(device, &QIODevice::readyRead, this, &HtmlLoader::loadChunk);
+    connect(device, &QIODevice::readChannelFinished, this, &HtmlLoader::channelFinished);
+  }
+  mTimer->start(0);
+}
+
+void HtmlLoader::channelFinished() {
+  mChannelFinished = true;
+  mTimer->start(0);
+}
+
+void HtmlLoader::cancel() {
+  if (isLoading()) stop(false);
+}
+
+void HtmlLoader::stop(bool complete) {
+  mTimer->stop();
+  disconnect(mDevice, nullptr, this, nullptr);
+  mDevice = nullptr;
+  delete mDecoder;
+  mDecoder = nullptr;
+  mPending.clear();
+  if (!mFirst) mDocument->setUndoRedoEnabled(mUndo);
+  emit finished(complete);
+}
+
+void HtmlLoader::loadChunk() {
+  if (!mDevice) return;
+  const bool sequential = mDevice->isSequential();
+  const QByteArray bytes = mDevice->read(mChunkSize);
+  if (bytes.isEmpty() && !mDevice->atEnd() && !sequential) {
+    stop(false);
+    return;
+  }
+  const bool atEnd = sequential ? mChannelFinished && mDevice->bytesAvailable() == 0 : mDevice->atEnd();
+  // readyRead() or readChannelFinished() calls again
+  if (bytes.isEmpty() && !atEnd) return;
+  if (!mDecoder) {
+    mDecoder = QTextCodec::codecForHtml(bytes, QTextCodec::codecForName("UTF-8"))->makeDecoder();
+  }
+  mPending += mDecoder->toUnicode(bytes);
+  mDone += bytes.size();
+
+  if (readHead(atEnd)) {
+    const int cut = atEnd ? mPending.size() : lastBoundary();
+    if (cut > 0) {
+      QString body = mPending.left(cut);
+      mPending.remove(0, cut);
+      mScanned -= cut;
+      if (atEnd) {
+        const int end = body.lastIndexOf("</body>", -1, Qt::CaseInsensitive);
+        if (end != -1) body.truncate(end);
+      }
+      append(body);
+    }
+  }
+
+  emit progress(mDone, sequential ? -1 : mDevice->size());
+  if (atEnd) {
+    stop(true);
+  } else if (!sequential || mDevice->bytesAvailable() > 0) {
+    mTimer->start(0);
+  }
+}
+
+bool HtmlLoader::readHead(bool atEnd) {
+  if (mHeadRead) return true;
+  const int body = mPending.indexOf("<body", 0, Qt::CaseInsensitive);
+  const int open = body == -1 ? -1 : mPending.indexOf('>', body);
+  if (open != -1) {
+    mHead = mPending.left(open + 1);
+    mPending.remove(0, open + 1);
+  } else if (atEnd || mPending.size() > 4 * mChunkSize) {
+    // a fragment without a head
+    mHead.clear();
+  } else {
+    return false;
+  }
+  mHeadRead = true;
+  return true;
+}
+
+// position after the last complete block outside of any container, 0 if none
+int HtmlLoader::lastBoundary() {
+  int boundary = 0;
+  int pos = mScanned;
+  while ((pos = mPending.indexOf('<', pos)) != -1) {
+    if (mPending.midRef(pos, 4) == QLatin1String("<!--")) {
+      const int end = mPending.indexOf("-->", pos + 4);
+      if (end == -1) break;
+      pos = end + 3;
+      continue;
+    }
+    const int end = mPending.indexOf('>', pos);
+    if (end == -1) break;
+    const bool closing = pos + 1 < end && mPending.at(pos + 1) == '/';
+    int nameEnd = pos + (closing ? 2 : 1);
+    while (nameEnd < end && mPending.at(nameEnd).isLetterOrNumber()) ++nameEnd;
+    const QStringRef name = mPending.midRef(pos + (closing ? 2 : 1), nameEnd - pos - (closing ? 2 : 1));
+    const bool selfClosing = mPending.at(end - 1) == '/';
+    if (isContainer(name) && !selfClosing) {
+      mDepth = qMax(0, mDepth + (closing ? -1 : 1));
+    }
+    pos = end + 1;
+    if (mDepth == 0 && (closing || selfClosing || name.compare(QLatin1String("hr"), Qt::CaseInsensitive) == 0)
+        && endsBlock(name)) {
+      boundary = pos;
+    }
+  }
+  // an unterminated tag or comment is scanned again with the next chunk
+  mScanned = pos == -1 ? mPending.size() : pos;
+  return boundary;
+}
+
+void HtmlLoader::append(const QString& body) {
+  QString html = mImages ? mImages->absorb(body) : body;
+  if (mFirst) {
+    mFirst = false;
+    // setHtml() drops the history anyway, the appended chunks add none
+    mUndo = mDocument->isUndoRedoEnabled();
+    mDocument->setUndoRedoEnabled(false);
+    mDocument->setHtml(mHead + html);
+    return;
+  }
+  QTextCursor cursor(mDocument);
+  cursor.movePosition(QTextCursor::End);
+  cursor.insertFragment(QTextDocumentFragment::fromHtml(mHead + MergedBlock + html, mDocument));
+}
@@ -0,0 +1,73 @@
+#ifndef HTMLLOADER_H
+#define HTMLLOADER_H
+
+#include <QObject>
+#include <QString>
+#include <QElapsedTimer>
+
+class QIODevice;
+class QTextDocument;
+class QTextDecoder;
+class QTimer;
+class ImageStore;
+
+// Loads HTML from a device into a document a piece at a time. Each event
+// loop turn reads a chunk, cuts it after the last top level block that is
+// complete and appends those blocks at the end of the document, so the
+// beginning can be read and edited while the rest is still coming in.
+// Like setHtml(), the first chunk replaces the document together with its
+// undo history; the new history starts when loading ends. Canceled before
+// the first chunk the document keeps both.
+class HtmlLoader : public QObject {
+  Q_OBJECT
+public:
+  explicit HtmlLoader(QTextDocument* document, QObject* parent = nullptr);
+  ~HtmlLoader();
+
+  void setChunkSize(int bytes) { mChunkSize = bytes; }
+  int chunkSize() const { return mChunkSize; }
+  // data URIs go into the store as the chunks arrive
+  void setImageStore(ImageStore* store) { mImages = store; }
+
+  // the device is read until atEnd() and must stay open until finished();
+  // a sequential one is read as readyRead() arrives until
+  // readChannelFinished(), so start before it is emitted
+  void start(QIODevice* device);
+  void cancel();
+  bool isLoading() const { return mDevice != nullptr; }
+
+signals:
+  // total is -1 for sequential devices
+  void progress(qint64 done, qint64 total);
+  // complete is false when canceled or the device failed
+  void finished(bool complete);
+
+private slots:
+  void loadChunk();
+  void channelFinished();
+
+private:
+  bool readHead(bool atEnd);
+  int lastBoundary();
+  void append(const QString& body);
+  void stop(bool complete);
+
+  QTextDocument* mDocument;
+  ImageStore* mImages = nullptr;
+  QIODevice* mDevice = nullptr;
+  QTextDecoder* mDecoder = nullptr;
+  QTimer* mTimer;
+  int mChunkSize = 256 * 1024;
+  qint64 mDone = 0;
+  bool mUndo = true;        // undo state of the document before loading
+  bool mChannelFinished = false;
+
+  QString mPending;         // decoded text not appended yet
+  QString mHead;            // everything up to and including <body ...>
+  bool mHeadRead = false;
+  bool mFirst = true;
+  int mScanned = 0;         // mPending is scanned for boundaries up to here
+  int mDepth = 0;           // open container elements at mScanned
+};
+
+#endif // HTMLLOADER_H
@@ -0,0 +1,309 @@
+#include "stdafx.h"
+#include "HtmlWriter.h"
+#include "Linkifier.h"
+#include <QIODevice>
+#include <QTextDocument>
+#include <QTextFrame>
+#include <QTextTable>
+#include <QTextBlock>
+#include <QTextList>
+#include <QTextFragment>
+
+namespace {
+
+// the buffer goes to the device once it holds this much
+const int FlushSize = 64 * 1024;
+
+QString colorName(const QBrush& brush) {
+    return brush.color().name();
+}
+
+const char* listStyle(QTextListFormat::Style style) {
+    switch (style) {
+    case QTextListFormat::ListCircle:     return "circle";
+    case QTextListFormat::ListSquare:     return "square";
+    case QTextListFormat::ListDecimal:    return "decimal";
+    case QTextListFormat::ListLowerAlpha: return "lower-alpha";
+    case QTextListFormat::ListUpperAlpha: return "upper-alpha";
+    case QTextListFormat::ListLowerRoman: return "lower-roman";
+    case QTextListFormat::ListUpperRoman: return "upper-roman";
+    case QTextListFormat::ListDisc:
+    default:                              return "disc";
+    }
+}
+
+bool isOrdered(QTextListFormat::Style style) {
+    return style == QTextListFormat::ListDecimal
+        || style == QTextListFormat::ListLowerAlpha || style == QTextListFormat::ListUpperAlpha
+        || style == QTextListFormat::ListLowerRoman || style == QTextListFormat::ListUpperRoman;
+}
+
+// only the properties set on the fragment, the rest comes from the body
+QString charStyle(const QTextCharFormat& format) {
+    QString style;
+    if (format.hasProperty(QTextFormat::FontFamily))
+        style += QString(" font-family:'%1';").arg(format.fontFamily());
+    if (format.hasProperty(QTextFormat::FontPointSize))
+        style += QString(" font-size:%1pt;").arg(format.fontPointSize());
+    if (format.hasProperty(QTextFormat::FontWeight))
+        style += QString(" font-weight:%1;").arg(format.fontWeight() * 8);
+    if (format.hasProperty(QTextFormat::FontItalic))
+        style += format.fontItalic() ? " font-style:italic;" : " font-style:normal;";
+    if (format.hasProperty(QTextFormat::FontUnderline) || format.hasProperty(QTextFormat::TextUnderlineStyle)
+        || format.hasProperty(QTextFormat::FontStrikeOut) || format.hasProperty(QTextFormat::FontOverline)) {
+        QString decoration;
+        if (format.fontUnderline()) decoration += " underline";
+        if (format.fontStrikeOut()) decoration += " line-through";
+        if (format.fontOverline()) decoration += " overline";
+        style += " text-decoration:" + (decoration.isEmpty() ? QString(" none") : decoration) + ';';
+    }
+    if (format.hasProperty(QTextFormat::ForegroundBrush))
+        style += " color:" + colorName(format.foreground()) + ';';
+    if (format.hasProperty(QTextFormat::BackgroundBrush))
+        style += " background-color:" + colorName(format.background()) + ';';
+    if (format.verticalAlignment() == QTextCharFormat::AlignSuperScript)
+        style += " vertical-align:super;";
+    else if (format.verticalAlignment() == QTextCharFormat::AlignSubScript)
+        style += " vertical-align:sub;";
+    return style;
+}
+
+QString blockStyle(const QTextBlockFormat& format) {
+    QString style = QString(" margin-top:%1px; margin-bottom:%2px; margin-left:%3px; margin-right:%4px;"
+                            " -qt-block-indent:%5; text-indent:%6px;")
+        .arg(format.topMargin()).arg(format.bottomMargin())
+        .arg(format.leftMargin()).arg(format.rightMargin())
+        .arg(format.indent()).arg(format.textIndent());
+    if (format.hasProperty(QTextFormat::BackgroundBrush))
+        style += " background-color:" + colorName(format.background()) + ';';
+    return style;
+}
+
+const char* alignment(Qt::Alignment align) {
+    if (align & Qt::AlignHCenter) return " align=\"center\"";
+    if (align & Qt::AlignJustify) return " align=\"justify\"";
+    if (align & Qt::AlignRight) return " align=\"right\"";
+    return "";
+}
+
+}
+
+HtmlWriter::HtmlWriter(QTextDocument* document)
+    : mDocument(document) {
+}
+
+void HtmlWriter::setImageStore(const ImageStore* store, ImageStore::Embedding embedding, const QString& directory) {
+    mImages = store;
+    mEmbedding = embedding;
+    mDirectory = directory;
+}
+
+bool HtmlWriter::write(QIODevice* device) {
+    mDevice = device;
+    mOk = true;
+    mList = nullptr;
+    mBuffer.resize(0);
+    mBuffer.reserve(FlushSize + 4096);
+
+    const QFont font = mDocument->defaultFont();
+    append("<!DOCTYPE HTML PUBLIC \"-//W3C//DTD HTML 4.0//EN\" \"http://www.w3.org/TR/REC-html40/strict.dtd\">\n"
+           "<html><head><meta name=\"qrichtext\" content=\"1\" />"
+           "<meta http-equiv=\"Content-Type\" content=\"text/html; charset=utf-8\" />"
+           "<style type=\"text/css\">\np, li { white-space: pre-wrap; }\n</style></head>");
+    append(QString("<body style=\" font-family:'%1'; font-size:%2pt; font-weight:%3; font-style:%4;\">\n")
+           .arg(font.family()).arg(font.pointSizeF()).arg(font.weight() * 8)
+           .arg(font.italic() ? "italic" : "normal"));
+    writeFrame(mDocument->rootFrame());
+    closeList();
+    append("</body></html>");
+    flush();
+    mDevice = nullptr;
+    return mOk;
+}
+
+void HtmlWriter::writeFrame(const QTextFrame* frame) {
+    bool first = true;
+    for (QTextFrame::iterator it = frame->begin(); !it.atEnd() && mOk; ++it) {
+        if (QTextFrame* child = it.currentFrame()) {
+            closeList();
+            if (const QTextTable* table = qobject_cast<const QTextTable*>(child)) {
+                writeTable(table);
+            } else {
+                writeFrame(child);
+            }
+            continue;
+        }
+        const QTextBlock block = it.currentBlock();
+        if (!block.isValid()) continue;
+        if (!first) append("\n");
+        first = false;
+        writeBlock(block);
+    }
+}
+
+void HtmlWriter::writeTable(const QTextTable* table) {
+    const QTextTableFormat format = table->format();
+    append(QString("<table border=\"%1\" cellspacing=\"%2\" cellpadding=\"%3\"%4>\n")
+           .arg(format.border()).arg(format.cellSpacing()).arg(format.cellPadding())
+           .arg(alignment(format.alignment())));
+    for (int row = 0; row < table->rows() && mOk; ++row) {
+        append("<tr>");
+        for (int column = 0; column < table->columns(); ++column) {
+            const QTextTableCell cell = table->cellAt(row, column);
+            // spanned cells are written once, at their top left
+            if (cell.row() != row || cell.column() != column) continue;
+            append("<td");
+            if (cell.rowSpan() > 1) append(QString(" rowspan=\"%1\"").arg(cell.rowSpan()));
+            if (cell.columnSpan() > 1) append(QString(" colspan=\"%1\"").arg(cell.columnSpan()));
+            append(">");
+            bool first = true;
+            for (QTextFrame::iterator it = cell.begin(); it != cell.end(); ++it) {
+                if (QTextFrame* child = it.currentFrame()) {
+                    closeList();
+                    if (const QTextTable* nested = qobject_cast<const QTextTable*>(child)) writeTable(nested);
+                    else writeFrame(child);
+                    continue;
+                }
+                if (!first) append("\n");
+                first = false;
+                writeBlock(it.currentBlock());
+            }
+            closeList();
+            append("</td>");
+        }
+        append("</tr>\n");
+    }
+    append("</table>");
+}
+
+void HtmlWriter::openList(const QTextList* list) {
+    if (list == mList) return;
+    closeList();
+    mList = list;
+    const QTextListFormat format = list->format();
+    append(isOrdered(format.style()) ? "<ol" : "<ul");
+    append(QString(" style=\"margin-top: 0px; margin-bottom: 0px; margin-left: 0px; margin-right: 0px;"
+                   " -qt-list-indent: %1; list-style-type: %2;\">")
+           .arg(format.indent()).arg(listStyle(format.style())));
+}
+
+void HtmlWriter::closeList() {
+    if (!mList) return;
+    append(isOrdered(mList->format().style()) ? "</ol>" : "</ul>");
+    mList = nullptr;
+}
+
+void HtmlWriter::writeBlock(const QTextBlock& block) {
+    const QTextBlockFormat format = block.blockFormat();
+    const char* tag = "p";
+    if (const QTextList* list = block.textList()) {
+        openList(list);
+        tag = "li";
+    } else {
+        closeList();
+    }
+    append("<");
+    append(tag);
+    append(alignment(format.alignment()));
+    append(" style=\"");
+    append(blockStyle(format));
+    if (block.length() == 1) append(" -qt-paragraph-type:empty;");
+    append("\">");
+    if (block.length() == 1) append("<br />");
+
+    const QString text = block.text();
+    const int base = block.position();
+    Linkifier::Links links;
+    if (mLinkifier) links = mLinkifier->links(block);
+    int link = 0;
+
+    for (QTextBlock::iterator it = block.begin(); !it.atEnd(); ++it) {
+        const QTextFragment fragment = it.fragment();
+        if (!fragment.isValid()) continue;
+        const QTextCharFormat charFormat = fragment.charFormat();
+        const int start = fragment.position() - base;
+        const int end = start + fragment.length();
+
+        if (charFormat.isImageFormat()) {
+            for (int i = start; i < end; ++i) writeImage(charFormat.toImageFormat().name(), charFormat);
+            continue;
+        }
+        const QString style = charStyle(charFormat);
+        if (charFormat.isAnchor()) {
+            append("<a href=\"");
+            appendEscaped(charFormat.anchorHref());
+            append("\">");
+        }
+        if (!style.isEmpty()) {
+            append("<span style=\"");
+            append(style);
+            append("\">");
+        }
+        // split the fragment at the links found in it
+        int pos = start;
+        for (; link < links.size() && links[link].offset < end; ++link) {
+            const Linkifier::Link& found = links[link];
+            if (found.offset < pos) continue;
+            writeText(text, pos, found.offset - pos);
+            append(found.email ? "<a href=\"mailto:" : "<a href=\"");
+            appendEscaped(text.mid(found.offset, found.length));
+            append("\">");
+            writeText(text, found.offset, found.length);
+            append("</a>");
+            pos = found.offset + found.length;
+        }
+        writeText(text, pos, end - pos);
+        if (!style.isEmpty()) append("</span>");
+        if (charFormat.isAnchor()) append("</a>");
+    }
+
+    append("</");
+    append(tag);
+    append(">");
+    if (mBuffer.size() >= FlushSize) flush();
+}
+
+void HtmlWriter::writeText(const QString& text, int from, int length) {
+    if (length <= 0) return;
+    QString escaped;
+    escaped.reserve(length + 16);
+    for (const QChar* c = text.constData() + from, *end = c + length; c != end; ++c) {
+        switch (c->unicode()) {
+        case '<': escaped += QLatin1String("&lt;"); break;
+        case '>': escaped += QLatin1String("&gt;"); break;
+        case '&': escaped += QLatin1String("&amp;"); break;
+        case '"': escaped += QLatin1String("&quot;"); break;
+        case QChar::Nbsp: escaped += QLatin1String("&nbsp;"); break;
+        case QChar::LineSeparator: escaped += QLatin1String("<br />"); break;
+        default: escaped += *c;
+        }
+    }
+    append(escaped);
+}
+
+void HtmlWriter::appendEscaped(const QString& text) {
+    writeText(text, 0, text.length());
+}
+
+void HtmlWriter::writeImage(const QString& name, const QTextCharFormat& format) {
+    const QTextImageFormat image = format.toImageFormat();
+    append("<img src=\"");
+    if (mImages && mImages->contains(name)) {
+        // the image data is encoded straight into the device
+        flush();
+        mOk = mOk && mImages->writeSource(name, mDevice, mEmbedding, mDirectory);
+    } else {
+        appendEscaped(name);
+    }
+    append("\"");
+    if (image.hasProperty(QTextFormat::ImageWidth)) append(QString(" width=\"%1\"").arg(image.width()));
+    if (image.hasProperty(QTextFormat::ImageHeight)) append(QString(" height=\"%1\"").arg(image.height()));
+    append(" />");
+}
+
+void HtmlWriter::flush() {
+    if (mBuffer.isEmpty()) return;
+    if (mOk && mDevice->write(mBuffer) != mBuffer.size()) mOk = false;
+    // reserved capacity survives resize(0), the buffer is allocated once
+    mBuffer.resize(0);
+}
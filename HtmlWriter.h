@@ -0,0 +1,58 @@
+#ifndef HTMLWRITER_H
+#define HTMLWRITER_H
+
+#include <QByteArray>
+#include <QString>
+#include "ImageStore.h"
+
+class QIODevice;
+class QTextDocument;
+class QTextFrame;
+class QTextTable;
+class QTextBlock;
+class QTextList;
+class QTextCharFormat;
+class Linkifier;
+
+// Writes a document as HTML to a device while walking its frames, blocks
+// and fragments. Output is buffered up to a fixed size, image data goes
+// straight from the store to the device, so memory does not grow with the
+// document. Links found by a Linkifier are written as anchors on the way.
+// Like QTextDocument::toHtml() every block of the body is one line, and
+// the result loads back through setHtml().
+class HtmlWriter {
+public:
+  explicit HtmlWriter(QTextDocument* document);
+
+  void setLinkifier(Linkifier* linkifier) { mLinkifier = linkifier; }
+  void setImageStore(const ImageStore* store, ImageStore::Embedding embedding = ImageStore::DataUris,
+                     const QString& directory = QString());
+
+  bool write(QIODevice* device);
+
+private:
+  void writeFrame(const QTextFrame* frame);
+  void writeTable(const QTextTable* table);
+  void writeBlock(const QTextBlock& block);
+  void writeText(const QString& text, int from, int length);
+  void writeImage(const QString& name, const QTextCharFormat& format);
+  void openList(const QTextList* list);
+  void closeList();
+  void append(const char* text) { mBuffer += text; }
+  void append(const QString& text) { mBuffer += text.toUtf8(); }
+  void appendEscaped(const QString& text);
+  void flush();
+
+  QTextDocument* mDocument;
+  Linkifier* mLinkifier = nullptr;
+  const ImageStore* mImages = nullptr;
+  ImageStore::Embedding mEmbedding = ImageStore::DataUris;
+  QString mDirectory;
+
+  QIODevice* mDevice = nullptr;
+  QByteArray mBuffer;
+  const QTextList* mList = nullptr;   // list with an open <ul> or <ol>
+  bool mOk = true;
+};
+
+#endif // HTMLWRITER_H
@@ -0,0 +1,50 @@
+#include "stdafx.h"
+#include "ImageEncoder.h"
+#include "ImageStore.h"
+#include "Timing.h"
+#include <QBuffer>
+#include <QImageReader>
+
+ImageEncoder::ImageEncoder(const QString& name, const QImage& image, const QByteArray& format, int quality)
+  : mName(name), mImage(image), mFormat(format), mQuality(quality) {
+  setAutoDelete(false);
+  connect(this, &ImageEncoder::encoded, this, &QObject::deleteLater);
+}
+
+ImageEncoder::ImageEncoder(const QString& name, const QString& path, const QByteArray& format, int quality)
+  : mName(name), mPath(path), mFormat(format), mQuality(quality) {
+  setAutoDelete(false);
+  connect(this, &ImageEncoder::encoded, this, &QObject::deleteLater);
+}
+
+ImageEncoder::ImageEncoder(const QString& name, const QByteArray& bytes)
+  : mName(name), mBytes(bytes), mQuality(-1) {
+  setAutoDelete(false);
+  connect(this, &ImageEncoder::encoded, this, &QObject::deleteLater);
+}
+
+void ImageEncoder::run() {
+  if (!mBytes.isEmpty()) {
+    const QImage image = QImage::fromData(mBytes);
+    emit encoded(mName, image, mBytes, QByteArray());
+    return;
+  }
+  QImage image = mImage;
+  if (image.isNull() && !mPath.isEmpty()) {
+    image = QImageReader(mPath).read();
+  }
+  const QByteArray bytes = encode(image, mFormat, mQuality);
+  const QByteArray key = ImageStore::key(bytes);
+  // last statement: the object may be deleted as soon as the signal is queued
+  emit encoded(mName, image, bytes, key);
+}
+
+QByteArray ImageEncoder::encode(const QImage& image, const QByteArray& format, int quality) {
+  QByteArray bytes;
+  if (image.isNull()) return bytes;
+  Timing::Scope timing("encodeImage", image.byteCount());
+  QBuffer buffer(&bytes);
+  buffer.open(QIODevice::WriteOnly);
+  image.save(&buffer, format.constData(), quality);
+  return bytes;
+}
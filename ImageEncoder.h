@@ -0,0 +1,37 @@
+#ifndef IMAGEENCODER_H
+#define IMAGEENCODER_H
+
+#include <QObject>
+#include <QRunnable>
+#include <QImage>
+#include <QByteArray>
+
+// Encodes one image for MTextEdit on a thread pool. A file is read there as
+// well; bytes kept as they are only get decoded for display. The result
+// arrives through encoded() on the thread that created the encoder, which
+// deletes itself afterwards.
+class ImageEncoder : public QObject, public QRunnable {
+  Q_OBJECT
+public:
+  ImageEncoder(const QString& name, const QImage& image, const QByteArray& format, int quality = -1);
+  ImageEncoder(const QString& name, const QString& path, const QByteArray& format, int quality = -1);
+  explicit ImageEncoder(const QString& name, const QByteArray& bytes);
+
+  void run() override;
+
+  static QByteArray encode(const QImage& image, const QByteArray& format, int quality = -1);
+
+signals:
+  // key is ImageStore::key(bytes), empty for bytes that were only decoded
+  void encoded(const QString& name, const QImage& image, const QByteArray& bytes, const QByteArray& key);
+
+private:
+  QString mName;
+  QImage mImage;
+  QString mPath;
+  QByteArray mBytes;
+  QByteArray mFormat;
+  int mQuality;
+};
+
+#endif // IMAGEENCODER_H
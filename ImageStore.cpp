@@ -0,0 +1,170 @@
+#include "stdafx.h"
+#include "ImageStore.h"
+#include "Base64.h"
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QIODevice>
+#include <string.h>
+
+namespace {
+
+const QString Prefix = "image:";
+const QString Source = "src=\"";
+
+}
+
+QByteArray ImageStore::key(const QByteArray& bytes) {
+  return QCryptographicHash::hash(bytes, QCryptographicHash::Sha1).toHex();
+}
+
+QString ImageStore::add(const QByteArray& bytes, const QByteArray& format, const QByteArray& key) {
+  const QByteArray k = key.isEmpty() ? ImageStore::key(bytes) : key;
+  if (!mImages.contains(k)) {
+    mImages.insert(k, Image{ bytes, format.toUpper() });
+  }
+  return Prefix + QString::fromLatin1(k) + '.' + QString::fromLatin1(format.toLower());
+}
+
+QByteArray ImageStore::keyOf(const QString& name) const {
+  const QString resolved = mAliases.value(name, name);
+  if (!resolved.startsWith(Prefix)) return QByteArray();
+  const int dot = resolved.indexOf('.', Prefix.size());
+  return resolved.midRef(Prefix.size(), dot == -1 ? -1 : dot - Prefix.size()).toLatin1();
+}
+
+qint64 ImageStore::memoryUsage() const {
+  qint64 size = 0;
+  for (const Image& image : mImages) size += image.bytes.capacity() + 40;
+  return size;
+}
+
+void ImageStore::clear() {
+  mImages.clear();
+  mAliases.clear();
+}
+
+void ImageStore::retain(const QSet<QString>& names) {
+  QSet<QByteArray> keys;
+  for (const QString& name : names) keys.insert(keyOf(name));
+  for (auto it = mImages.begin(); it != mImages.end();) {
+    if (keys.contains(it.key())) ++it;
+    else it = mImages.erase(it);
+  }
+  for (auto it = mAliases.begin(); it != mAliases.end();) {
+    if (keys.contains(keyOf(it.key()))) ++it;
+    else it = mAliases.erase(it);
+  }
+}
+
+QString ImageStore::mimeType(const QString& name) const {
+  const QString type = QString::fromLatin1(format(name)).toLower();
+  return "image/" + (type == "jpg" ? QString("jpeg") : type);
+}
+
+QString ImageStore::fileName(const QString& name) const {
+  const QByteArray k = keyOf(name);
+  return QString::fromLatin1(k) + '.' + QString::fromLatin1(mImages.value(k).format.toLower());
+}
+
+QByteArray ImageStore::dataUri(const QString& name) const {
+  const QByteArray header = "data:" + mimeType(name).toLatin1() + ";base64,";
+  const QByteArray data = bytes(name);
+  QByteArray uri(header.size() + Base64::encodedSize(data.size(), mLineLength), Qt::Uninitialized);
+  memcpy(uri.data(), header.constData(), header.size());
+  Base64::encode(data.constData(), data.size(), uri.data() + header.size(), mLineLength);
+  return uri;
+}
+
+bool ImageStore::writeDataUri(const QString& name, QIODevice* device) const {
+  const QByteArray data = bytes(name);
+  return device->write("data:" + mimeType(name).toLatin1() + ";base64,") != -1
+      && Base64::encode(data.constData(), data.size(), device, mLineLength);
+}
+
+bool ImageStore::saveFile(const QString& name, const QString& directory) const {
+  QFile file(QDir(directory).filePath(fileName(name)));
+  // content addressed: an existing file already holds these bytes
+  if (file.exists()) return true;
+  return file.open(QIODevice::WriteOnly) && file.write(bytes(name)) == bytes(name).size();
+}
+
+QString ImageStore::absorb(const QString& html) {
+  static const QString data = Source + "data:image/";
+  QString result;
+  int from = 0;
+  for (int at = html.indexOf(data); at != -1; at = html.indexOf(data, at)) {
+    const int begin = at + Source.size();
+    const int end = html.indexOf('"', begin);
+    if (end == -1) break;
+    const int comma = html.indexOf(',', begin);
+    const int semicolon = html.lastIndexOf(";base64", comma);
+    if (comma == -1 || comma > end || semicolon < begin) {
+      at = end;
+      continue;
+    }
+    const QByteArray format = html.midRef(begin + 11, semicolon - begin - 11).toLatin1();
+    const QByteArray bytes = QByteArray::fromBase64(html.midRef(comma + 1, end - comma - 1).toLatin1());
+    if (result.isEmpty()) result.reserve(html.size());
+    result += html.midRef(from, begin - from);
+    result += add(bytes, format == "jpeg" ? QByteArray("jpg") : format);
+    from = end;
+    at = end;
+  }
+  if (from == 0) return html;
+  result += html.midRef(from);
+  return result;
+}
+
+template <typename Text, typename Name>
+bool ImageStore::replaceNames(const QString& html, Text text, Name name) const {
+  static const QString image = Source + "image";
+  int from = 0;
+  for (int at = html.indexOf(image); at != -1; at = html.indexOf(image, at)) {
+    const int begin = at + Source.size();
+    const int end = html.indexOf('"', begin);
+    if (end == -1) break;
+    at = end;
+    const QString found = html.mid(begin, end - begin);
+    if (!contains(found)) continue;
+    if (!text(html.midRef(from, begin - from)) || !name(found)) return false;
+    from = end;
+  }
+  return text(html.midRef(from));
+}
+
+QString ImageStore::serialize(const QString& html, Embedding embedding, const QString& directory) const {
+  QString result;
+  result.reserve(html.size());
+  const bool ok = replaceNames(html,
+    [&](const QStringRef& text) {
+      result += text;
+      return true;
+    },
+    [&](const QString& name) {
+      if (embedding == ExternalFiles) {
+        result += fileName(name);
+        return saveFile(name, directory);
+      }
+      result += QLatin1String(dataUri(name));
+      return true;
+    });
+  return ok ? result : QString();
+}
+
+bool ImageStore::serialize(const QString& html, QIODevice* device, Embedding embedding, const QString& directory) const {
+  return replaceNames(html,
+    [&](const QStringRef& text) {
+      return device->write(text.toUtf8()) != -1;
+    },
+    [&](const QString& name) {
+      return writeSource(name, device, embedding, directory);
+    });
+}
+
+bool ImageStore::writeSource(const QString& name, QIODevice* device, Embedding embedding, const QString& directory) const {
+  if (embedding == ExternalFiles) {
+    return saveFile(name, directory) && device->write(fileName(name).toUtf8()) != -1;
+  }
+  return writeDataUri(name, device);
+}
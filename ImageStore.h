@@ -0,0 +1,70 @@
+#ifndef IMAGESTORE_H
+#define IMAGESTORE_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QSet>
+#include <QString>
+
+class QIODevice;
+
+// Encoded images of a document keyed by the SHA-1 of their bytes. Image
+// formats only carry the name, "image:<sha1>.<ext>", or an alias given out
+// before the bytes were known. Identical images are stored once. Data URIs
+// or external files are produced when the HTML is serialized.
+class ImageStore {
+public:
+  enum Embedding {
+      DataUris,       // src="data:image/png;base64,..."
+      ExternalFiles   // src="<sha1>.png", written next to the document
+  };
+
+  static QByteArray key(const QByteArray& bytes);
+
+  // the name of the stored image, key may be passed when already computed
+  QString add(const QByteArray& bytes, const QByteArray& format, const QByteArray& key = QByteArray());
+  void addAlias(const QString& alias, const QString& name) { mAliases.insert(alias, name); }
+  bool contains(const QString& name) const { return mImages.contains(keyOf(name)); }
+  QByteArray bytes(const QString& name) const { return mImages.value(keyOf(name)).bytes; }
+  QByteArray format(const QString& name) const { return mImages.value(keyOf(name)).format; }
+  int count() const { return mImages.size(); }
+  qint64 memoryUsage() const;
+  void clear();
+  // drops the images none of the names refer to
+  void retain(const QSet<QString>& names);
+
+  // base64 line length of data URIs, a multiple of 4, 0 for a single line
+  void setLineLength(int length) { mLineLength = length; }
+  int lineLength() const { return mLineLength; }
+
+  QString mimeType(const QString& name) const;
+  QString fileName(const QString& name) const;
+  QByteArray dataUri(const QString& name) const;
+  bool writeDataUri(const QString& name, QIODevice* device) const;
+  // what goes into src="" for the image
+  bool writeSource(const QString& name, QIODevice* device, Embedding embedding = DataUris, const QString& directory = QString()) const;
+
+  // moves data URIs out of html into the store, leaving names behind
+  QString absorb(const QString& html);
+  // replaces the names in html by data URIs or file names, the device
+  // receives UTF-8 and the image bytes are encoded piece by piece
+  QString serialize(const QString& html, Embedding embedding = DataUris, const QString& directory = QString()) const;
+  bool serialize(const QString& html, QIODevice* device, Embedding embedding = DataUris, const QString& directory = QString()) const;
+
+private:
+  struct Image {
+      QByteArray bytes;
+      QByteArray format;
+  };
+
+  QByteArray keyOf(const QString& name) const;
+  bool saveFile(const QString& name, const QString& directory) const;
+  template <typename Text, typename Name>
+  bool replaceNames(const QString& html, Text text, Name name) const;
+
+  QHash<QByteArray, Image> mImages;
+  QHash<QString, QString> mAliases;
+  int mLineLength = 0;
+};
+
+#endif // IMAGESTORE_H
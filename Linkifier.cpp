@@ -0,0 +1,98 @@
+#include "stdafx.h"
+#include "Linkifier.h"
+#include <QRegExp>
+#include <QScopedPointer>
+#include <QTextCursor>
+#include <QTextBlock>
+#include <QTextDocument>
+#include <QTextFragment>
+#include <algorithm>
+
+namespace {
+
+const QRegExp& emailPattern() {
+    static const QRegExp rx("[a-zA-Z\\d]+@[a-zA-Z\\d]+\\.[a-zA-Z]+");
+    return rx;
+}
+
+const QRegExp& urlPattern() {
+    static const QRegExp rx("(?:https?|ftp|file)://[^\\s'\"<>]+");
+    return rx;
+}
+
+}
+
+Linkifier::Linkifier(QTextDocument* document, QObject* parent)
+    : QObject(parent)
+    , mDocument(document)
+    , mCache(document)
+    , mRescanned(0)
+{
+    connect(mDocument, &QTextDocument::contentsChange, this, &Linkifier::onContentsChange);
+}
+
+void Linkifier::onContentsChange(int from, int /*removed*/, int added) {
+    mCache.contentsChange(from, added);
+}
+
+const Linkifier::Links& Linkifier::links(const QTextBlock& block) {
+    auto& entry = mCache.entry(block.blockNumber());
+    if (!entry.valid) {
+        entry.value = scan(block);
+        entry.valid = true;
+        ++mRescanned;
+    }
+    return entry.value;
+}
+
+Linkifier::Links Linkifier::scan(const QTextBlock& block) const {
+    Links result;
+    const int base = block.position();
+    for (auto it = block.begin(); !it.atEnd(); ++it) {
+        const QTextFragment fragment = it.fragment();
+        if (!fragment.isValid() || fragment.charFormat().isAnchor()) continue;
+        const QString text = fragment.text();
+        const int offset = fragment.position() - base;
+        // like the former html pass: a link starts a fragment or follows a space
+        for (const QRegExp* pattern : { &emailPattern(), &urlPattern() }) {
+            QRegExp rx(*pattern);
+            int pos = 0;
+            while ((pos = rx.indexIn(text, pos)) != -1) {
+                if (pos == 0 || text.at(pos - 1).isSpace()) {
+                    result << Link{ offset + pos, rx.matchedLength(), pattern == &emailPattern() };
+                }
+                pos += rx.matchedLength();
+            }
+        }
+    }
+    std::sort(result.begin(), result.end(), [](const Link& a, const Link& b) { return a.offset < b.offset; });
+    return result;
+}
+
+QString Linkifier::toHtml() {
+    QScopedPointer<QTextDocument> copy;
+    for (QTextBlock block = mDocument->begin(); block.isValid(); block = block.next()) {
+        const Links& found = links(block);
+        if (found.isEmpty()) continue;
+        if (!copy) {
+            copy.reset(mDocument->clone());
+            copy->setUndoRedoEnabled(false);
+        }
+        const QString text = block.text();
+        const int base = copy->findBlockByNumber(block.blockNumber()).position();
+        QTextCursor cursor(copy.data());
+        int end = 0;
+        for (const Link& link : found) {
+            // an address inside a url is part of that link
+            if (link.offset < end) continue;
+            end = link.offset + link.length;
+            QTextCharFormat format;
+            format.setAnchor(true);
+            format.setAnchorHref((link.email ? "mailto:" : "") + text.mid(link.offset, link.length));
+            cursor.setPosition(base + link.offset);
+            cursor.setPosition(base + end, QTextCursor::KeepAnchor);
+            cursor.mergeCharFormat(format);
+        }
+    }
+    return copy ? copy->toHtml() : mDocument->toHtml();
+}
@@ -0,0 +1,46 @@
+#ifndef LINKIFIER_H
+#define LINKIFIER_H
+
+#include <QObject>
+#include <QVector>
+#include "BlockCache.h"
+
+class QTextDocument;
+class QTextBlock;
+
+// Finds the e-mail addresses and urls of a document and turns them into
+// links when it is serialized, by toHtml() or by HtmlWriter. Matches are
+// kept per block and only blocks changed since the previous call are
+// scanned again; text that already is an anchor is left alone.
+class Linkifier : public QObject {
+  Q_OBJECT
+public:
+  struct Link {
+    int offset;   // relative to the block
+    int length;
+    bool email;
+  };
+  using Links = QVector<Link>;
+
+  explicit Linkifier(QTextDocument* document, QObject* parent = nullptr);
+
+  const Links& links(const QTextBlock& block);
+  // QTextDocument::toHtml() of the document with the links as anchors,
+  // set on a copy at their block positions
+  QString toHtml();
+  // blocks scanned so far, the others came from the cache
+  int rescannedBlocks() const { return mRescanned; }
+
+private slots:
+  void onContentsChange(int from, int removed, int added);
+
+private:
+  Links scan(const QTextBlock& block) const;
+
+private:
+  QTextDocument* mDocument;
+  BlockCache<Links> mCache;
+  int mRescanned;
+};
+
+#endif // LINKIFIER_H
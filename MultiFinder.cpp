@@ -0,0 +1,96 @@
+#include "stdafx.h"
+#include "MultiFinder.h"
+#include <QMap>
+
+MultiFinder::MultiFinder(const QStringList& patterns, Options options)
+    : mOptions(options)
+    , mBuilt(false)
+{
+    for (const QString& pattern : patterns) addPattern(pattern);
+}
+
+int MultiFinder::addPattern(const QString& pattern) {
+    if (pattern.isEmpty()) return -1;
+    mPatterns << pattern;
+    mBuilt = false;
+    return mPatterns.size() - 1;
+}
+
+void MultiFinder::clear() {
+    mPatterns.clear();
+    mBuilt = false;
+}
+
+void MultiFinder::setOptions(Options options) {
+    if ((options & CaseInsensitive) != (mOptions & CaseInsensitive)) mBuilt = false;
+    mOptions = options;
+}
+
+void MultiFinder::build() const {
+    // plain trie first, flattened into sorted edge arrays below
+    QVector<QMap<ushort, int>> trie(1);
+    QVector<int> ends(1, -1);
+    mNextSame.fill(-1, mPatterns.size());
+    for (int id = 0; id < mPatterns.size(); ++id) {
+        int node = 0;
+        for (QChar ch : mPatterns.at(id)) {
+            const ushort c = fold(ch);
+            auto it = trie[node].constFind(c);
+            if (it == trie[node].constEnd()) {
+                trie[node].insert(c, trie.size());
+                node = trie.size();
+                trie.append(QMap<ushort, int>());
+                ends.append(-1);
+            } else {
+                node = it.value();
+            }
+        }
+        if (ends[node] == -1) {
+            ends[node] = id;
+        } else {
+            int last = ends[node];
+            while (mNextSame[last] != -1) last = mNextSame[last];
+            mNextSame[last] = id;
+        }
+    }
+
+    mNodes.resize(trie.size());
+    mEdgeChars.clear();
+    mEdgeTargets.clear();
+    for (int node = 0; node < trie.size(); ++node) {
+        Node& n = mNodes[node];
+        n.firstEdge = mEdgeChars.size();
+        n.edgeCount = trie[node].size();
+        n.fail = 0;
+        n.output = 0;
+        n.pattern = ends[node];
+        for (auto it = trie[node].constBegin(); it != trie[node].constEnd(); ++it) {
+            mEdgeChars << it.key();
+            mEdgeTargets << it.value();
+        }
+    }
+
+    // breadth first: fail links of a node only depend on shallower nodes
+    QVector<int> queue;
+    queue.reserve(mNodes.size());
+    queue << 0;
+    for (int head = 0; head < queue.size(); ++head) {
+        const int node = queue[head];
+        const Node n = mNodes[node];
+        for (int e = 0; e < n.edgeCount; ++e) {
+            const ushort c = mEdgeChars[n.firstEdge + e];
+            const int target = mEdgeTargets[n.firstEdge + e];
+            int fail = 0;
+            if (node != 0) {
+                int f = n.fail;
+                while ((fail = child(f, c)) == -1 && f != 0) f = mNodes[f].fail;
+                if (fail == -1) fail = 0;
+            }
+            Node& t = mNodes[target];
+            t.fail = fail;
+            t.output = t.pattern != -1 ? target : mNodes[fail].output;
+            queue << target;
+        }
+    }
+    mBuilt = true;
+}
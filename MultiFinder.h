@@ -0,0 +1,124 @@
+#ifndef MULTIFINDER_H
+#define MULTIFINDER_H
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QTextDocument>
+#include <QTextBlock>
+
+// Finds any number of patterns in one pass (Aho-Corasick automaton).
+// Matches are reported as ranges to a visitor, bool visitor(const Range&),
+// which returns false to stop the scan.
+class MultiFinder {
+public:
+  enum Option {
+      NoOptions = 0x0,
+      CaseInsensitive = 0x1,
+      WholeWords = 0x2
+  };
+  Q_DECLARE_FLAGS(Options, Option)
+
+  struct Range {
+      int start;
+      int length;
+      int patternId;
+  };
+
+  explicit MultiFinder(const QStringList& patterns = QStringList(), Options options = NoOptions);
+
+  int addPattern(const QString& pattern);
+  QString pattern(int patternId) const { return mPatterns.at(patternId); }
+  int patternCount() const { return mPatterns.size(); }
+  void clear();
+
+  void setOptions(Options options);
+  Options options() const { return mOptions; }
+
+  template <typename Visitor>
+  bool scan(const QChar* text, int length, int offset, Visitor visitor) const;
+  template <typename Visitor>
+  bool scan(const QString& text, Visitor visitor) const
+      { return scan(text.constData(), text.length(), 0, visitor); }
+  template <typename Visitor>
+  bool scan(const QTextBlock& block, Visitor visitor) const;
+  template <typename Visitor>
+  void scan(const QTextDocument* document, Visitor visitor) const;
+
+private:
+  struct Node {
+      int firstEdge;
+      int edgeCount;
+      int fail;
+      int output;   // nearest node on the fail chain ending a pattern, 0 if none
+      int pattern;  // first pattern ending here, -1 if none
+  };
+
+  void build() const;
+  int child(int node, ushort c) const;
+  ushort fold(QChar c) const
+      { return (mOptions & CaseInsensitive) ? c.toCaseFolded().unicode() : c.unicode(); }
+  static bool isWordChar(QChar c) { return c.isLetterOrNumber() || c == QLatin1Char('_'); }
+
+private:
+  QStringList mPatterns;
+  Options mOptions;
+  mutable bool mBuilt;
+  mutable QVector<Node> mNodes;
+  mutable QVector<ushort> mEdgeChars;
+  mutable QVector<int> mEdgeTargets;
+  mutable QVector<int> mNextSame;    // further patterns ending on the same node
+};
+
+Q_DECLARE_OPERATORS_FOR_FLAGS(MultiFinder::Options)
+
+inline int MultiFinder::child(int node, ushort c) const {
+    const Node& n = mNodes.at(node);
+    const ushort* first = mEdgeChars.constData() + n.firstEdge;
+    int lo = 0, hi = n.edgeCount;
+    while (lo < hi) {
+        const int mid = (lo + hi) / 2;
+        if (first[mid] < c) lo = mid + 1;
+        else hi = mid;
+    }
+    return (lo < n.edgeCount && first[lo] == c) ? mEdgeTargets.at(n.firstEdge + lo) : -1;
+}
+
+template <typename Visitor>
+bool MultiFinder::scan(const QChar* text, int length, int offset, Visitor visitor) const {
+    if (!mBuilt) build();
+    if (mPatterns.isEmpty()) return true;
+    int state = 0;
+    for (int i = 0; i < length; ++i) {
+        const ushort c = fold(text[i]);
+        int next;
+        while ((next = child(state, c)) == -1 && state != 0) state = mNodes.at(state).fail;
+        state = next == -1 ? 0 : next;
+        for (int node = mNodes.at(state).output; node != 0; node = mNodes.at(mNodes.at(node).fail).output) {
+            for (int id = mNodes.at(node).pattern; id != -1; id = mNextSame.at(id)) {
+                const int len = mPatterns.at(id).length();
+                const int start = i + 1 - len;
+                if ((mOptions & WholeWords)
+                    && ((start > 0 && isWordChar(text[start - 1])) || (i + 1 < length && isWordChar(text[i + 1])))) {
+                    continue;
+                }
+                if (!visitor(Range{ offset + start, len, id })) return false;
+            }
+        }
+    }
+    return true;
+}
+
+template <typename Visitor>
+bool MultiFinder::scan(const QTextBlock& block, Visitor visitor) const {
+    const QString text = block.text();
+    return scan(text.constData(), text.length(), block.position(), visitor);
+}
+
+template <typename Visitor>
+void MultiFinder::scan(const QTextDocument* document, Visitor visitor) const {
+    for (QTextBlock block = document->begin(); block.isValid(); block = block.next()) {
+        if (!scan(block, visitor)) return;
+    }
+}
+
+#endif // MULTIFINDER_H
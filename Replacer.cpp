@@ -0,0 +1,111 @@
+#include "stdafx.h"
+#include "Replacer.h"
+#include <QRegExp>
+#include <QTextBlock>
+#include <QTextCursor>
+#include <QTextDocument>
+#include "MultiFinder.h"
+
+namespace {
+
+// \0..\9 refer to the captured texts, \\ is a backslash
+QString expand(const QString& replacement, const QRegExp& rx) {
+    if (!replacement.contains('\\')) return replacement;
+    QString result;
+    result.reserve(replacement.size());
+    for (int i = 0; i < replacement.size(); ++i) {
+        const QChar ch = replacement.at(i);
+        if (ch == '\\' && i + 1 < replacement.size()) {
+            const QChar next = replacement.at(i + 1);
+            if (next.isDigit()) {
+                result += rx.cap(next.digitValue());
+                ++i;
+                continue;
+            }
+            if (next == '\\') {
+                result += next;
+                ++i;
+                continue;
+            }
+        }
+        result += ch;
+    }
+    return result;
+}
+
+bool coversObject(const QString& text, int start, int length) {
+    return text.midRef(start, length).contains(QChar::ObjectReplacementCharacter);
+}
+
+}
+
+Replacer::Replacer(QTextDocument* document)
+    : mDocument(document)
+{
+}
+
+int Replacer::replaceAll(const QString& pattern, const QString& replacement, Options options) {
+    if (pattern.isEmpty()) return 0;
+    const Matches matches = (options & RegularExpression)
+        ? findRegExp(pattern, replacement, options)
+        : findPlain(pattern, replacement, options);
+    return apply(matches);
+}
+
+Replacer::Matches Replacer::findPlain(const QString& pattern, const QString& replacement, Options options) const {
+    Matches matches;
+    MultiFinder::Options finderOptions = MultiFinder::NoOptions;
+    if (options & CaseInsensitive) finderOptions |= MultiFinder::CaseInsensitive;
+    if (options & WholeWords) finderOptions |= MultiFinder::WholeWords;
+    MultiFinder finder(QStringList(pattern), finderOptions);
+    for (QTextBlock block = mDocument->begin(); block.isValid(); block = block.next()) {
+        const QString text = block.text();
+        int end = 0;
+        finder.scan(text, [&](const MultiFinder::Range& range) {
+            // the automaton reports overlapping matches, keep them left to right
+            if (range.start >= end && !coversObject(text, range.start, range.length)) {
+                matches << Match{ block.position() + range.start, range.length, replacement };
+                end = range.start + range.length;
+            }
+            return true;
+        });
+    }
+    return matches;
+}
+
+Replacer::Matches Replacer::findRegExp(const QString& pattern, const QString& replacement, Options options) const {
+    Matches matches;
+    QString source = pattern;
+    if (options & WholeWords) source = QString("\\b(?:%1)\\b").arg(pattern);
+    QRegExp rx(source, (options & CaseInsensitive) ? Qt::CaseInsensitive : Qt::CaseSensitive);
+    if (!rx.isValid()) return matches;
+    for (QTextBlock block = mDocument->begin(); block.isValid(); block = block.next()) {
+        const QString text = block.text();
+        int pos = 0;
+        while ((pos = rx.indexIn(text, pos)) != -1) {
+            const int length = rx.matchedLength();
+            if (length > 0 && !coversObject(text, pos, length)) {
+                matches << Match{ block.position() + pos, length, expand(replacement, rx) };
+            }
+            pos += qMax(length, 1);
+        }
+    }
+    return matches;
+}
+
+int Replacer::apply(const Matches& matches) {
+    if (matches.isEmpty()) return 0;
+    QTextCursor cursor(mDocument);
+    cursor.beginEditBlock();
+    // backwards, so the positions of the remaining matches stay valid
+    for (int i = matches.size() - 1; i >= 0; --i) {
+        const Match& match = matches.at(i);
+        cursor.setPosition(match.start + 1);
+        const QTextCharFormat format = cursor.charFormat();
+        cursor.setPosition(match.start);
+        cursor.setPosition(match.start + match.length, QTextCursor::KeepAnchor);
+        cursor.insertText(match.text, format);
+    }
+    cursor.endEditBlock();
+    return matches.size();
+}
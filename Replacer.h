@@ -0,0 +1,42 @@
+#ifndef REPLACER_H
+#define REPLACER_H
+#include <QString>
+#include <QVector>
+
+class QTextDocument;
+
+// Replaces all matches in a document through QTextCursor inside a single
+// edit block, so formats, images and the undo history are kept.
+class Replacer {
+public:
+  enum Option {
+      NoOptions = 0x0,
+      CaseInsensitive = 0x1,
+      WholeWords = 0x2,
+      RegularExpression = 0x4   // QRegExp syntax, \1..\9 in the replacement
+  };
+  Q_DECLARE_FLAGS(Options, Option)
+
+  explicit Replacer(QTextDocument* document);
+
+  int replaceAll(const QString& pattern, const QString& replacement, Options options = NoOptions);
+
+private:
+  struct Match {
+      int start;
+      int length;
+      QString text;
+  };
+  using Matches = QVector<Match>;
+
+  Matches findPlain(const QString& pattern, const QString& replacement, Options options) const;
+  Matches findRegExp(const QString& pattern, const QString& replacement, Options options) const;
+  int apply(const Matches& matches);
+
+private:
+  QTextDocument* mDocument;
+};
+
+Q_DECLARE_OPERATORS_FOR_FLAGS(Replacer::Options)
+
+#endif // REPLACER_H
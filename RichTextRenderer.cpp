@@ -0,0 +1,174 @@
+#include "stdafx.h"
+#include "RichTextRenderer.h"
+#include <QAbstractTextDocumentLayout>
+#include <QGuiApplication>
+#include <QImage>
+#include <QPainter>
+#include <QPaintDevice>
+#include <QSet>
+#include <QTextBlock>
+#include <QTextDocument>
+#include <QtMath>
+#include "Timing.h"
+
+namespace {
+
+// resolves the names ImageStore::absorb() left in the html and counts the
+// images it names for as long as it lives
+class Document : public QTextDocument {
+public:
+  Document(const ImageStore& images, QHash<QString, int>& refs, bool& released)
+    : mImages(images), mRefs(refs), mReleased(released) {}
+
+  ~Document() {
+    for (const QString& name : mNames) {
+      auto it = mRefs.find(name);
+      if (it == mRefs.end() || --*it > 0) continue;
+      mRefs.erase(it);
+      mReleased = true;
+    }
+  }
+
+  void setHtml(const QString& html) {
+    QTextDocument::setHtml(html);
+    for (QTextBlock block = begin(); block.isValid(); block = block.next()) {
+      for (QTextBlock::iterator it = block.begin(); !it.atEnd(); ++it) {
+        const QTextCharFormat format = it.fragment().charFormat();
+        if (!format.isImageFormat()) continue;
+        const QString name = format.toImageFormat().name();
+        if (mNames.contains(name) || !mImages.contains(name)) continue;
+        mNames.insert(name);
+        ++mRefs[name];
+      }
+    }
+  }
+
+protected:
+  QVariant loadResource(int type, const QUrl& name) override {
+    if (type == QTextDocument::ImageResource && mImages.contains(name.toString())) {
+      return QImage::fromData(mImages.bytes(name.toString()));
+    }
+    return QTextDocument::loadResource(type, name);
+  }
+
+private:
+  const ImageStore& mImages;
+  QHash<QString, int>& mRefs;
+  bool& mReleased;
+  QSet<QString> mNames;
+};
+
+RichTextRenderer* sShared = nullptr;
+
+// pixmaps go with the application, the renderer itself stays to the end
+void clearShared() {
+  sShared->clear();
+}
+
+}
+
+uint qHash(const RichTextRenderer::LayoutKey& key, uint seed) {
+  return qHash(key.html, seed) ^ uint(key.width);
+}
+
+uint qHash(const RichTextRenderer::Key& key, uint seed) {
+  return qHash(key.html, seed) ^ uint(key.width) ^ (key.text * 31) ^ uint(key.devicePixelRatio * 64);
+}
+
+RichTextRenderer::RichTextRenderer(int memoryBudget)
+  : mLayouts(256), mPixmaps(memoryBudget), mMargin(4) {
+}
+
+RichTextRenderer::~RichTextRenderer() {
+}
+
+RichTextRenderer* RichTextRenderer::shared() {
+  if (!sShared) {
+    sShared = new RichTextRenderer;
+    qAddPostRoutine(clearShared);
+  }
+  return sShared;
+}
+
+void RichTextRenderer::setFont(const QFont& font) {
+  mFont = font;
+  clear();
+}
+
+void RichTextRenderer::setDocumentMargin(qreal margin) {
+  mMargin = margin;
+  clear();
+}
+
+QTextDocument* RichTextRenderer::layout(const QString& html, int width) {
+  const LayoutKey key = { html, width };
+  QTextDocument* document = mLayouts.object(key);
+  if (!document) {
+    Timing::Scope timing("render.layout", html.size());
+    Document* created = new Document(mImages, mImageRefs, mImagesReleased);
+    created->setUndoRedoEnabled(false);
+    created->setDefaultFont(mFont);
+    created->setDocumentMargin(mMargin);
+    created->setHtml(mImages.absorb(html));
+    created->setTextWidth(width);
+    document = created;
+    // may evict another layout
+    mLayouts.insert(key, document);
+    releaseImages();
+  }
+  return document;
+}
+
+void RichTextRenderer::releaseImages() {
+  if (!mImagesReleased) return;
+  mImagesReleased = false;
+  mImages.retain(mImageRefs.keys().toSet());
+}
+
+int RichTextRenderer::heightForWidth(const QString& html, int width) {
+  return qCeil(layout(html, width)->size().height());
+}
+
+QPixmap RichTextRenderer::render(const QString& html, int width, qreal devicePixelRatio, const QColor& text) {
+  const Key key = { html, width, devicePixelRatio, text.rgba() };
+  if (const QPixmap* pixmap = mPixmaps.object(key)) return *pixmap;
+
+  QTextDocument* document = layout(html, width);
+  Timing::Scope timing("render.draw", html.size());
+  const QSize size(width, qCeil(document->size().height()));
+  QPixmap pixmap(size * devicePixelRatio);
+  pixmap.setDevicePixelRatio(devicePixelRatio);
+  pixmap.fill(Qt::transparent);
+  QPainter painter(&pixmap);
+  QAbstractTextDocumentLayout::PaintContext context;
+  context.palette.setColor(QPalette::Text, text);
+  document->documentLayout()->draw(&painter, context);
+  painter.end();
+
+  // a pixmap over the whole budget is drawn every time rather than evicting everything
+  const int cost = pixmap.width() * pixmap.height() * pixmap.depth() / 8;
+  if (cost <= mPixmaps.maxCost()) mPixmaps.insert(key, new QPixmap(pixmap), cost);
+  return pixmap;
+}
+
+void RichTextRenderer::paint(QPainter* painter, const QPoint& position, const QString& html, int width, const QColor& text) {
+  const qreal ratio = painter->device() ? painter->device()->devicePixelRatioF() : qApp->devicePixelRatio();
+  painter->drawPixmap(position, render(html, width, ratio, text));
+}
+
+void RichTextRenderer::invalidate(const QString& html) {
+  for (const LayoutKey& key : mLayouts.keys()) {
+    if (key.html == html) mLayouts.remove(key);
+  }
+  for (const Key& key : mPixmaps.keys()) {
+    if (key.html == html) mPixmaps.remove(key);
+  }
+  releaseImages();
+}
+
+void RichTextRenderer::clear() {
+  mLayouts.clear();
+  mPixmaps.clear();
+  mImages.clear();
+  mImagesReleased = false;
+}
@@ -0,0 +1,87 @@
+#ifndef RICHTEXTRENDERER_H
+#define RICHTEXTRENDERER_H
+
+#include <QCache>
+#include <QColor>
+#include <QFont>
+#include <QHash>
+#include <QPixmap>
+#include <QString>
+#include "ImageStore.h"
+
+class QPainter;
+class QTextDocument;
+
+// Draws rich HTML for display only, without an editor. A document is laid
+// out once per width and the drawing is kept as a pixmap per width, device
+// pixel ratio and text color, so repainting is a blit. Pixmaps are evicted
+// least recently used beyond the memory budget, layouts beyond a count.
+// Data URIs are moved into an image store shared by all documents, an
+// image leaves it with the last layout naming it. GUI thread only.
+class RichTextRenderer {
+public:
+  explicit RichTextRenderer(int memoryBudget = 32 * 1024 * 1024);
+  ~RichTextRenderer();
+
+  // the renderer RichTextView and RichTextDelegate use unless given another
+  static RichTextRenderer* shared();
+
+  // both drop everything cached
+  void setFont(const QFont& font);
+  QFont font() const { return mFont; }
+  void setDocumentMargin(qreal margin);
+  qreal documentMargin() const { return mMargin; }
+
+  // bytes of pixmaps kept, at least one pixmap is always drawn
+  void setMemoryBudget(int bytes) { mPixmaps.setMaxCost(bytes); }
+  int memoryBudget() const { return mPixmaps.maxCost(); }
+  void setMaxLayouts(int count) { mLayouts.setMaxCost(count); releaseImages(); }
+  int maxLayouts() const { return mLayouts.maxCost(); }
+  // pixmaps and stored images
+  qint64 memoryUsage() const { return mPixmaps.totalCost() + mImages.memoryUsage(); }
+
+  int heightForWidth(const QString& html, int width);
+  QPixmap render(const QString& html, int width, qreal devicePixelRatio, const QColor& text);
+  // at the painter's device pixel ratio
+  void paint(QPainter* painter, const QPoint& position, const QString& html, int width, const QColor& text);
+
+  // the html changed meaning, e.g. an image it names was replaced
+  void invalidate(const QString& html);
+  void clear();
+
+private:
+  Q_DISABLE_COPY(RichTextRenderer)
+
+  struct LayoutKey {
+    QString html;
+    int width;
+    bool operator==(const LayoutKey& other) const { return width == other.width && html == other.html; }
+  };
+  friend uint qHash(const LayoutKey& key, uint seed);
+
+  struct Key {
+    QString html;
+    int width;
+    qreal devicePixelRatio;
+    QRgb text;
+    bool operator==(const Key& other) const {
+      return width == other.width && devicePixelRatio == other.devicePixelRatio
+          && text == other.text && html == other.html;
+    }
+  };
+  friend uint qHash(const Key& key, uint seed);
+
+  QTextDocument* layout(const QString& html, int width);
+  void releaseImages();
+
+  // before the layouts, their documents read the store and count references
+  ImageStore mImages;
+  QHash<QString, int> mImageRefs;   // layouts naming each image
+  bool mImagesReleased = false;     // some image is named by no layout any more
+  QCache<LayoutKey, QTextDocument> mLayouts;
+  QCache<Key, QPixmap> mPixmaps;
+  QFont mFont;
+  qreal mMargin;
+};
+
+#endif // RICHTEXTRENDERER_H
@@ -0,0 +1,64 @@
+#include "stdafx.h"
+#include "RichTextView.h"
+#include <QApplication>
+#include <QPainter>
+#include "RichTextRenderer.h"
+
+RichTextView::RichTextView(QWidget* parent)
+  : QWidget(parent), mRenderer(RichTextRenderer::shared()) {
+  QSizePolicy policy(QSizePolicy::Preferred, QSizePolicy::Preferred);
+  policy.setHeightForWidth(true);
+  setSizePolicy(policy);
+}
+
+void RichTextView::setRenderer(RichTextRenderer* renderer) {
+  mRenderer = renderer;
+  updateGeometry();
+  update();
+}
+
+void RichTextView::setHtml(const QString& html) {
+  if (html == mHtml) return;
+  mHtml = html;
+  updateGeometry();
+  update();
+}
+
+int RichTextView::heightForWidth(int width) const {
+  return mRenderer->heightForWidth(mHtml, width);
+}
+
+QSize RichTextView::sizeHint() const {
+  const int width = this->width() > 0 ? this->width() : 400;
+  return QSize(width, heightForWidth(width));
+}
+
+void RichTextView::paintEvent(QPaintEvent*) {
+  QPainter painter(this);
+  mRenderer->paint(&painter, QPoint(0, 0), mHtml, width(), palette().color(QPalette::Text));
+}
+
+RichTextDelegate::RichTextDelegate(QObject* parent)
+  : QStyledItemDelegate(parent), mRenderer(RichTextRenderer::shared()) {
+}
+
+void RichTextDelegate::paint(QPainter* painter, const QStyleOptionViewItem& option, const QModelIndex& index) const {
+  QStyleOptionViewItem opt = option;
+  initStyleOption(&opt, index);
+  const QString html = opt.text;
+  // background, focus and selection from the style, the text from the cache
+  opt.text.clear();
+  const QStyle* style = opt.widget ? opt.widget->style() : QApplication::style();
+  style->drawControl(QStyle::CE_ItemViewItem, &opt, painter, opt.widget);
+
+  const QPalette::ColorRole role = (opt.state & QStyle::State_Selected) ? QPalette::HighlightedText : QPalette::Text;
+  painter->save();
+  painter->setClipRect(opt.rect);
+  mRenderer->paint(painter, opt.rect.topLeft(), html, opt.rect.width(), opt.palette.color(role));
+  painter->restore();
+}
+
+QSize RichTextDelegate::sizeHint(const QStyleOptionViewItem& option, const QModelIndex& index) const {
+  const int width = option.rect.width() > 0 ? option.rect.width() : 400;
+  return QSize(width, mRenderer->heightForWidth(index.data(Qt::DisplayRole).toString(), width));
+}
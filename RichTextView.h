@@ -0,0 +1,52 @@
+#ifndef RICHTEXTVIEW_H
+#define RICHTEXTVIEW_H
+
+#include <QStyledItemDelegate>
+#include <QWidget>
+
+class RichTextRenderer;
+
+// Read-only display of rich HTML, painted from a RichTextRenderer's cache
+// instead of hosting an editor. Its height follows its width.
+class RichTextView : public QWidget {
+  Q_OBJECT
+public:
+  explicit RichTextView(QWidget* parent = nullptr);
+
+  // RichTextRenderer::shared() by default, not owned
+  void setRenderer(RichTextRenderer* renderer);
+  RichTextRenderer* renderer() const { return mRenderer; }
+
+  void setHtml(const QString& html);
+  QString html() const { return mHtml; }
+
+  bool hasHeightForWidth() const override { return true; }
+  int heightForWidth(int width) const override;
+  QSize sizeHint() const override;
+
+protected:
+  void paintEvent(QPaintEvent* event) override;
+
+private:
+  RichTextRenderer* mRenderer;
+  QString mHtml;
+};
+
+// Paints the HTML of Qt::DisplayRole, so a view shows thousands of rich
+// snippets without a widget per item.
+class RichTextDelegate : public QStyledItemDelegate {
+  Q_OBJECT
+public:
+  explicit RichTextDelegate(QObject* parent = nullptr);
+
+  void setRenderer(RichTextRenderer* renderer) { mRenderer = renderer; }
+  RichTextRenderer* renderer() const { return mRenderer; }
+
+  void paint(QPainter* painter, const QStyleOptionViewItem& option, const QModelIndex& index) const override;
+  QSize sizeHint(const QStyleOptionViewItem& option, const QModelIndex& index) const override;
+
+private:
+  RichTextRenderer* mRenderer;
+};
+
+#endif // RICHTEXTVIEW_H
@@ -0,0 +1,120 @@
+#include "stdafx.h"
+#include "SearchIndex.h"
+#include <QTextDocument>
+#include <algorithm>
+
+SearchIndex::SearchIndex(QTextDocument* document, QObject* parent)
+    : QObject(parent)
+    , mDocument(document)
+    , mCache(document)
+    , mNextId(0)
+    , mPostingCount(0)
+{
+    indexBlocks(0, mCache.size() - 1);
+    connect(mDocument, &QTextDocument::contentsChange, this, &SearchIndex::onContentsChange);
+}
+
+QVector<quint64> SearchIndex::trigrams(const QString& text) {
+    QVector<quint64> result;
+    const int len = text.length();
+    if (len < 3) return result;
+    result.reserve(len - 2);
+    const QChar* data = text.constData();
+    quint64 key = (quint64(data[0].toCaseFolded().unicode()) << 16) | data[1].toCaseFolded().unicode();
+    for (int i = 2; i < len; ++i) {
+        key = ((key << 16) | data[i].toCaseFolded().unicode()) & Q_UINT64_C(0xffffffffffff);
+        result << key;
+    }
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+    return result;
+}
+
+void SearchIndex::onContentsChange(int from, int /*removed*/, int added) {
+    const auto span = mCache.contentsChange(from, added, [this](Entry& entry) { drop(entry); });
+    indexBlocks(span.first, span.last);
+}
+
+void SearchIndex::indexBlocks(int first, int last) {
+    if (first > last) return;
+    QTextBlock block = mDocument->findBlockByNumber(first);
+    for (int n = first; n <= last && block.isValid(); ++n, block = block.next()) {
+        auto& cached = mCache.entry(n);
+        Entry& entry = cached.value;
+        entry.id = mNextId++;
+        entry.trigrams = trigrams(block.text());
+        for (quint64 trigram : entry.trigrams) mPostings[trigram].insert(entry.id);
+        mPostingCount += entry.trigrams.size();
+        mBlocks.insert(entry.id, block);
+        cached.valid = true;
+    }
+}
+
+void SearchIndex::drop(Entry& entry) {
+    for (quint64 trigram : entry.trigrams) {
+        auto it = mPostings.find(trigram);
+        if (it == mPostings.end()) continue;
+        it->remove(entry.id);
+        if (it->isEmpty()) mPostings.erase(it);
+    }
+    mPostingCount -= entry.trigrams.size();
+    mBlocks.remove(entry.id);
+    entry.trigrams.clear();
+}
+
+QVector<QTextBlock> SearchIndex::candidates(const QString& query) const {
+    QVector<QTextBlock> result;
+    const QVector<quint64> keys = trigrams(query);
+    if (keys.isEmpty()) {
+        // too short to use the index
+        for (QTextBlock block = mDocument->begin(); block.isValid(); block = block.next()) result << block;
+        return result;
+    }
+    QVector<const QSet<int>*> sets;
+    for (quint64 key : keys) {
+        auto it = mPostings.constFind(key);
+        if (it == mPostings.constEnd()) return result;
+        sets << &it.value();
+    }
+    std::sort(sets.begin(), sets.end(), [](const QSet<int>* a, const QSet<int>* b) { return a->size() < b->size(); });
+    for (int id : *sets.first()) {
+        bool all = true;
+        for (int i = 1; i < sets.size() && all; ++i) all = sets[i]->contains(id);
+        if (all) result << mBlocks.value(id);
+    }
+    std::sort(result.begin(), result.end(), [](const QTextBlock& a, const QTextBlock& b) { return a.position() < b.position(); });
+    return result;
+}
+
+QList<QTextCursor> SearchIndex::find(const QString& query, Qt::CaseSensitivity cs) const {
+    return find(candidates(query), query, cs);
+}
+
+QList<QTextCursor> SearchIndex::find(const QVector<QTextBlock>& blocks, const QString& query, Qt::CaseSensitivity cs) {
+    QList<QTextCursor> result;
+    if (query.isEmpty()) return result;
+    for (const QTextBlock& block : blocks) {
+        if (!block.isValid()) continue;
+        const QString text = block.text();
+        int index = 0;
+        while ((index = text.indexOf(query, index, cs)) != -1) {
+            QTextCursor cursor(block);
+            cursor.setPosition(block.position() + index);
+            cursor.setPosition(block.position() + index + query.length(), QTextCursor::KeepAnchor);
+            result << cursor;
+            index += query.length();
+        }
+    }
+    return result;
+}
+
+qint64 SearchIndex::memoryUsage() const {
+    // estimate of the heap used by the containers, hash nodes carry a next pointer and the hash
+    const qint64 node = sizeof(void*) + sizeof(uint);
+    qint64 bytes = 0;
+    bytes += mPostings.size() * (node + sizeof(quint64) + sizeof(QSet<int>) + sizeof(void*));
+    bytes += mPostingCount * (node + sizeof(int) + sizeof(void*) + sizeof(quint64));
+    bytes += mBlocks.size() * (node + sizeof(int) + sizeof(QTextBlock) + sizeof(void*));
+    bytes += mCache.size() * sizeof(BlockCache<Entry>::Entry);
+    return bytes;
+}
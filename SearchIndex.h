@@ -0,0 +1,54 @@
+#ifndef SEARCHINDEX_H
+#define SEARCHINDEX_H
+
+#include <QObject>
+#include <QHash>
+#include <QSet>
+#include <QVector>
+#include <QTextBlock>
+#include <QTextCursor>
+#include "BlockCache.h"
+
+class QTextDocument;
+
+// Case-insensitive trigram index over the blocks of a document, updated
+// from QTextDocument::contentsChange. A query only visits the blocks that
+// contain all of its trigrams.
+class SearchIndex : public QObject {
+  Q_OBJECT
+public:
+  explicit SearchIndex(QTextDocument* document, QObject* parent = nullptr);
+
+  QTextDocument* document() const { return mDocument; }
+
+  QVector<QTextBlock> candidates(const QString& query) const;
+  QList<QTextCursor> find(const QString& query, Qt::CaseSensitivity cs = Qt::CaseInsensitive) const;
+  static QList<QTextCursor> find(const QVector<QTextBlock>& blocks, const QString& query,
+                                 Qt::CaseSensitivity cs = Qt::CaseInsensitive);
+
+  int trigramCount() const { return mPostings.size(); }
+  qint64 memoryUsage() const;
+
+private slots:
+  void onContentsChange(int from, int removed, int added);
+
+private:
+  struct Entry {
+    int id;
+    QVector<quint64> trigrams;
+  };
+
+  static QVector<quint64> trigrams(const QString& text);
+  void indexBlocks(int first, int last);
+  void drop(Entry& entry);
+
+private:
+  QTextDocument* mDocument;
+  BlockCache<Entry> mCache;
+  QHash<quint64, QSet<int>> mPostings;
+  QHash<int, QTextBlock> mBlocks;
+  int mNextId;
+  qint64 mPostingCount;
+};
+
+#endif // SEARCHINDEX_H
@@ -1,6 +1,10 @@
 #include "stdafx.h"
 #include "SearchWidget.h"
 #include <QVBoxLayout>
+#include <QTextDocument>
+#include "MultiFinder.h"
+#include "Replacer.h"
+#include "SearchIndex.h"
 
 SearchWidget::SearchWidget(QWidget* parent, bool inDirs)
     : QWidget(parent)
@@ -9,6 +13,9 @@ SearchWidget::SearchWidget(QWidget* parent, bool inDirs)
     , mSearchButton(new QPushButton(QIcon(":/search.png"), "Find", this))
     , mReplaceButton(new QPushButton(QIcon(":/replace.png"), "Replace", this))
     , mInDirs(inDirs)
+    , mDocument(nullptr)
+    , mIndex(nullptr)
+    , mDirectorySearch(nullptr)
 {
     QVBoxLayout* layout = new QVBoxLayout(this);
 
@@ -20,6 +27,13 @@ SearchWidget::SearchWidget(QWidget* parent, bool inDirs)
 
     connect(mSearchButton, &QPushButton::clicked, this, &SearchWidget::onSearchClicked);
     connect(mReplaceButton, &QPushButton::clicked, this, &SearchWidget::onReplaceClicked);
+    connect(mSearchWordLineEdit, &QLineEdit::textEdited, this, &SearchWidget::onSearchTextEdited);
+
+    if (mInDirs) {
+        mDirectorySearch = new DirectorySearch(this);
+        connect(mDirectorySearch, &DirectorySearch::hitsFound, this, &SearchWidget::directoryHitsFound);
+        connect(mDirectorySearch, &DirectorySearch::finished, this, &SearchWidget::directorySearchFinished);
+    }
 
     refresh();
 }
@@ -54,16 +68,82 @@ QWidget* SearchWidget::docWidget()
     //return qobject_cast<DocumentWidget*>(parent());
 }
 
+void SearchWidget::setDocument(QTextDocument* document)
+{
+    if (mDocument) disconnect(mDocument, nullptr, this, nullptr);
+    const bool indexed = mIndex != nullptr;
+    delete mIndex;
+    mIndex = nullptr;
+    mDocument = document;
+    if (mDocument) connect(mDocument, &QTextDocument::contentsChanged, this, &SearchWidget::onDocumentChanged);
+    onDocumentChanged();
+    setIndexEnabled(indexed);
+}
+
+void SearchWidget::setDirectory(const QString& directory)
+{
+    mDirectory = directory;
+    if (mDirectorySearch) mDirectorySearch->cancel();
+}
+
+void SearchWidget::setIndexEnabled(bool enable)
+{
+    if (enable && !mIndex && mDocument) {
+        mIndex = new SearchIndex(mDocument, this);
+    } else if (!enable) {
+        delete mIndex;
+        mIndex = nullptr;
+    }
+}
+
+void SearchWidget::onDocumentChanged()
+{
+    mLastQuery.clear();
+    mLastBlocks.clear();
+}
+
+void SearchWidget::onSearchTextEdited(const QString& text)
+{
+    if (mDirectorySearch) {
+        // restarting cancels the search for the previous query
+        if (!mDirectory.isEmpty()) mDirectorySearch->start(mDirectory, text);
+        return;
+    }
+    if (!mDocument) return;
+    QVector<QTextBlock> blocks;
+    if (!mLastQuery.isEmpty() && text.startsWith(mLastQuery, Qt::CaseInsensitive)) {
+        // the query grew: only blocks matching the shorter one can match
+        blocks = mLastBlocks;
+    } else if (mIndex) {
+        blocks = mIndex->candidates(text);
+    } else {
+        MultiFinder finder(QStringList(text), MultiFinder::CaseInsensitive);
+        finder.scan(mDocument, [&](const MultiFinder::Range& range) {
+            const QTextBlock block = mDocument->findBlock(range.start);
+            if (blocks.isEmpty() || blocks.last() != block) blocks << block;
+            return true;
+        });
+    }
+    const QList<QTextCursor> matches = SearchIndex::find(blocks, text);
+    mLastQuery = text;
+    mLastBlocks.clear();
+    for (const QTextCursor& match : matches) {
+        if (mLastBlocks.isEmpty() || mLastBlocks.last() != match.block()) mLastBlocks << match.block();
+    }
+    emit matchesFound(matches);
+}
+
 void SearchWidget::onSearchClicked()
 {
+    onDocumentChanged();
+    onSearchTextEdited(mSearchWordLineEdit->text());
 }
 
 void SearchWidget::onReplaceClicked()
 {
-//     QString src = mSearchWordLineEdit->text();
-//     QString dst = mReplaceWordLineEdit->text();
-//     if (auto *p = docWidget()) {
-//         QString all = p->getSourceText();
-//         p->setText(all.replace(src, dst));
-//     }
+    const QString src = mSearchWordLineEdit->text();
+    const QString dst = mReplaceWordLineEdit->text();
+    if (mDocument && !src.isEmpty()) {
+        Replacer(mDocument).replaceAll(src, dst);
+    }
 }
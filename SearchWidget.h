@@ -4,8 +4,13 @@
 #include <QWidget>
 #include <QLineEdit>
 #include <QPushButton>
+#include <QTextCursor>
+#include <QTextBlock>
+#include "DirectorySearch.h"
 
 class DocumentWidget;
+class QTextDocument;
+class SearchIndex;
 class SearchWidget : public QWidget {
   Q_OBJECT
 public:
@@ -13,6 +18,16 @@ public:
 
 public:
   void setReplaceEnabled(bool enable = true);
+  void setDocument(QTextDocument* document);
+  void setIndexEnabled(bool enable = true);
+  const SearchIndex* index() const { return mIndex; }
+  void setDirectory(const QString& directory);
+  QString directory() const { return mDirectory; }
+
+signals:
+  void matchesFound(const QList<QTextCursor>& matches);
+  void directoryHitsFound(const DirectorySearch::Hits& hits);
+  void directorySearchFinished();
 
 private:
   QWidget* createSearchPanel();
@@ -24,6 +39,8 @@ private:
 protected slots:
 void onSearchClicked();
 void onReplaceClicked();
+void onSearchTextEdited(const QString& text);
+void onDocumentChanged();
 
 private:
   QLineEdit*   mSearchWordLineEdit;
@@ -32,6 +49,12 @@ private:
   QPushButton* mReplaceButton;
 private:
   bool mInDirs;
+  QTextDocument* mDocument;
+  SearchIndex*   mIndex;
+  QString        mLastQuery;
+  QVector<QTextBlock> mLastBlocks;
+  QString          mDirectory;
+  DirectorySearch* mDirectorySearch;
 };
 
 #endif // SEARCHWIDGET_H
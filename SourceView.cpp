@@ -0,0 +1,90 @@
+#include "stdafx.h"
+#include "SourceView.h"
+#include <QPainter>
+#include <QPaintEvent>
+#include <QTextBlock>
+
+class SourceView::Gutter : public QWidget {
+public:
+  explicit Gutter(SourceView* view) : QWidget(view), mView(view) {}
+  QSize sizeHint() const override { return QSize(mView->gutterWidth(), 0); }
+
+protected:
+  void paintEvent(QPaintEvent* event) override { mView->paintGutter(event); }
+
+private:
+  SourceView* mView;
+};
+
+SourceView::SourceView(QWidget* parent)
+  : QPlainTextEdit(parent), mDigits(0) {
+  mGutter = new Gutter(this);
+  setLineWrapMode(QPlainTextEdit::NoWrap);
+  QFont font("Courier New");
+  font.setStyleHint(QFont::Monospace);
+  setFont(font);
+
+  connect(this, &QPlainTextEdit::blockCountChanged, this, &SourceView::updateGutterWidth);
+  connect(this, &QPlainTextEdit::updateRequest, this, &SourceView::updateGutter);
+  updateGutterWidth();
+}
+
+int SourceView::gutterWidth() const {
+  return 8 + fontMetrics().width(QLatin1Char('9')) * mDigits;
+}
+
+int SourceView::lastVisibleBlockNumber() const {
+  QTextBlock block = firstVisibleBlock();
+  const int bottom = viewport()->height();
+  int last = block.blockNumber();
+  for (qreal top = blockBoundingGeometry(block).translated(contentOffset()).top();
+       block.isValid() && top <= bottom; block = block.next()) {
+    last = block.blockNumber();
+    top += blockBoundingRect(block).height();
+  }
+  return last;
+}
+
+void SourceView::updateGutterWidth() {
+  int digits = 1;
+  for (int count = qMax(1, blockCount()); count >= 10; count /= 10) ++digits;
+  // at least three digits, the margin only changes when the count gains one
+  digits = qMax(3, digits);
+  if (digits == mDigits) return;
+  mDigits = digits;
+  setViewportMargins(gutterWidth(), 0, 0, 0);
+}
+
+void SourceView::updateGutter(const QRect& rect, int dy) {
+  if (dy) {
+    mGutter->scroll(0, dy);
+  } else {
+    mGutter->update(0, rect.y(), mGutter->width(), rect.height());
+  }
+}
+
+void SourceView::resizeEvent(QResizeEvent* event) {
+  QPlainTextEdit::resizeEvent(event);
+  const QRect area = contentsRect();
+  mGutter->setGeometry(QRect(area.left(), area.top(), gutterWidth(), area.height()));
+}
+
+void SourceView::paintGutter(QPaintEvent* event) {
+  QPainter painter(mGutter);
+  painter.fillRect(event->rect(), palette().color(QPalette::Window));
+  painter.setPen(palette().color(QPalette::Mid));
+
+  // only the blocks on screen, QPlainTextEdit knows them without a layout pass
+  QTextBlock block = firstVisibleBlock();
+  int number = block.blockNumber();
+  qreal top = blockBoundingGeometry(block).translated(contentOffset()).top();
+  const int width = mGutter->width() - 4;
+  const int height = fontMetrics().height();
+  for (; block.isValid() && top <= event->rect().bottom(); block = block.next(), ++number) {
+    const qreal bottom = top + blockBoundingRect(block).height();
+    if (block.isVisible() && bottom >= event->rect().top()) {
+      painter.drawText(0, int(top), width, height, Qt::AlignRight, QString::number(number + 1));
+    }
+    top = bottom;
+  }
+}
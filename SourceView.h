@@ -0,0 +1,34 @@
+#ifndef SOURCEVIEW_H
+#define SOURCEVIEW_H
+
+#include <QPlainTextEdit>
+
+// Plain text editor for the HTML source with line numbers in a gutter.
+// QPlainTextEdit lays out only the lines it shows, so large sources open
+// and scroll quickly; a QSyntaxHighlighter works on its document as usual.
+class SourceView : public QPlainTextEdit {
+  Q_OBJECT
+public:
+  explicit SourceView(QWidget* parent = nullptr);
+
+  int gutterWidth() const;
+  int firstVisibleBlockNumber() const { return firstVisibleBlock().blockNumber(); }
+  int lastVisibleBlockNumber() const;
+
+protected:
+  void resizeEvent(QResizeEvent* event) override;
+
+private slots:
+  void updateGutterWidth();
+  void updateGutter(const QRect& rect, int dy);
+
+private:
+  class Gutter;
+  friend class Gutter;
+  void paintGutter(QPaintEvent* event);
+
+  Gutter* mGutter;
+  int mDigits;
+};
+
+#endif // SOURCEVIEW_H
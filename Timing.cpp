@@ -0,0 +1,67 @@
+#include "stdafx.h"
+#include "Timing.h"
+#include <QHash>
+#include <QMutex>
+#include <string.h>
+
+Q_LOGGING_CATEGORY(htmleditorTiming, "htmleditor.timing", QtWarningMsg)
+
+QAtomicInt Timing::sEnabled(qEnvironmentVariableIsSet("HTMLEDITOR_TIMING") ? 1 : 0);
+
+namespace {
+
+struct Registry {
+  QMutex mutex;
+  QHash<QByteArray, Timing::Stats> stats;
+};
+
+Registry& registry() {
+  static Registry registry;
+  return registry;
+}
+
+int bucket(qint64 nsecs) {
+  int i = 0;
+  for (qint64 usecs = nsecs / 1000; usecs > 1 && i < Timing::Buckets - 1; usecs >>= 1) ++i;
+  return i;
+}
+
+}
+
+void Timing::record(const char* operation, qint64 nsecs, qint64 size) {
+  qCDebug(htmleditorTiming, "%s %.3f ms, size %lld", operation, nsecs / 1e6, size);
+  Registry& r = registry();
+  QMutexLocker lock(&r.mutex);
+  // the raw key only looks up, the first record stores a copy
+  const QByteArray key = QByteArray::fromRawData(operation, int(strlen(operation)));
+  auto it = r.stats.find(key);
+  if (it == r.stats.end()) {
+    it = r.stats.insert(QByteArray(operation), Stats());
+    it->operation = it.key();
+  }
+  ++it->count;
+  it->totalNsecs += nsecs;
+  it->maxNsecs = qMax(it->maxNsecs, nsecs);
+  it->totalSize += size;
+  ++it->histogram[bucket(nsecs)];
+}
+
+QList<Timing::Stats> Timing::stats() {
+  Registry& r = registry();
+  QMutexLocker lock(&r.mutex);
+  return r.stats.values();
+}
+
+Timing::Stats Timing::stats(const char* operation) {
+  Registry& r = registry();
+  QMutexLocker lock(&r.mutex);
+  Stats empty;
+  empty.operation = operation;
+  return r.stats.value(QByteArray::fromRawData(operation, int(strlen(operation))), empty);
+}
+
+void Timing::reset() {
+  Registry& r = registry();
+  QMutexLocker lock(&r.mutex);
+  r.stats.clear();
+}
@@ -0,0 +1,62 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QList>
+#include <QLoggingCategory>
+#include <QVector>
+
+// Logs every timed operation at debug level when enabled, e.g. with
+// QT_LOGGING_RULES="htmleditor.timing.debug=true".
+Q_DECLARE_LOGGING_CATEGORY(htmleditorTiming)
+
+// Opt-in timing of editor operations. While disabled a Scope costs one
+// relaxed atomic load. Enable with Timing::setEnabled(true) or by setting
+// HTMLEDITOR_TIMING in the environment; statistics per operation are then
+// collected with a histogram of durations for the host to export.
+class Timing {
+public:
+  enum { Buckets = 24 };   // bucket i counts durations of [2^i, 2^(i+1)) microseconds
+
+  struct Stats {
+    QByteArray operation;
+    qint64 count = 0;
+    qint64 totalNsecs = 0;
+    qint64 maxNsecs = 0;
+    qint64 totalSize = 0;    // sum of the input sizes, in the unit of the operation
+    QVector<qint64> histogram = QVector<qint64>(Buckets);
+  };
+
+  static bool isEnabled() { return sEnabled.load() != 0; }
+  static void setEnabled(bool enabled) { sEnabled.store(enabled ? 1 : 0); }
+
+  static void record(const char* operation, qint64 nsecs, qint64 size);
+  static QList<Stats> stats();
+  static Stats stats(const char* operation);
+  static void reset();
+
+  // times its lifetime when enabled at construction
+  class Scope {
+  public:
+    explicit Scope(const char* operation, qint64 size = 0)
+      : mOperation(isEnabled() ? operation : nullptr), mSize(size) {
+      if (mOperation) mTimer.start();
+    }
+    ~Scope() {
+      if (mOperation) record(mOperation, mTimer.nsecsElapsed(), mSize);
+    }
+    void setSize(qint64 size) { mSize = size; }
+
+  private:
+    Q_DISABLE_COPY(Scope)
+    const char* mOperation;
+    qint64 mSize;
+    QElapsedTimer mTimer;
+  };
+
+private:
+  static QAtomicInt sEnabled;
+};
+
+#endif // TIMING_H
@@ -0,0 +1,62 @@
+#include "stdafx.h"
+#include "ToolbarResources.h"
+#include <QApplication>
+#include <QClipboard>
+#include <QFontDatabase>
+#include <QMimeData>
+#include <QPixmap>
+#include "ui_richtexttoolbar.h"
+
+ToolbarResources* ToolbarResources::instance() {
+  static ToolbarResources* resources = new ToolbarResources(qApp);
+  return resources;
+}
+
+ToolbarResources::ToolbarResources(QObject* parent)
+  : QObject(parent), mCanPaste(false) {
+  for (int size : QFontDatabase::standardSizes()) {
+    mFontSizeIndex.insert(size, mFontSizes.size());
+    mFontSizes << QString::number(size);
+  }
+#ifndef QT_NO_CLIPBOARD
+  connect(QApplication::clipboard(), &QClipboard::dataChanged, this, &ToolbarResources::clipboardDataChanged);
+  if (const QMimeData* md = QApplication::clipboard()->mimeData()) mCanPaste = md->hasText();
+#endif
+}
+
+QIcon ToolbarResources::icon(const QString& theme) {
+  auto it = mIcons.constFind(theme);
+  if (it == mIcons.constEnd()) it = mIcons.insert(theme, QIcon::fromTheme(theme));
+  return *it;
+}
+
+QIcon ToolbarResources::colorSwatch(const QColor& color) {
+  auto it = mSwatches.constFind(color.rgba());
+  if (it != mSwatches.constEnd()) return *it;
+  // a document rarely uses more than a handful of colors
+  if (mSwatches.size() >= 64) mSwatches.clear();
+  QPixmap pix(16, 16);
+  pix.fill(color);
+  return *mSwatches.insert(color.rgba(), QIcon(pix));
+}
+
+void ToolbarResources::clipboardDataChanged() {
+#ifndef QT_NO_CLIPBOARD
+  const QMimeData* md = QApplication::clipboard()->mimeData();
+  const bool canPaste = md && md->hasText();
+  if (canPaste != mCanPaste) {
+    mCanPaste = canPaste;
+    emit canPasteChanged(canPaste);
+  }
+#endif
+}
+
+int ToolbarResources::toolbarHeight() {
+  if (mToolbarHeight < 0) {
+    QWidget toolbar;
+    Ui::RichTextToolbar ui;
+    ui.setupUi(&toolbar);
+    mToolbarHeight = toolbar.sizeHint().height();
+  }
+  return mToolbarHeight;
+}
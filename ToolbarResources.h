@@ -0,0 +1,51 @@
+#ifndef TOOLBARRESOURCES_H
+#define TOOLBARRESOURCES_H
+
+#include <QColor>
+#include <QHash>
+#include <QIcon>
+#include <QObject>
+#include <QStringList>
+
+// What every MRichTextEdit toolbar needs and nothing distinguishes between
+// editors: the font size items, theme icons, color swatches and the state of
+// the clipboard. Made once per process on first use and owned by the
+// application object; GUI thread only.
+class ToolbarResources : public QObject {
+  Q_OBJECT
+public:
+  static ToolbarResources* instance();
+
+  // QFontDatabase::standardSizes() as combo items
+  const QStringList& fontSizes() const { return mFontSizes; }
+  // item of the size in fontSizes(), -1 if it has none
+  int fontSizeIndex(int pointSize) const { return mFontSizeIndex.value(pointSize, -1); }
+
+  QIcon icon(const QString& theme);
+  QIcon colorSwatch(const QColor& color);
+
+  // the clipboard holds text
+  bool canPaste() const { return mCanPaste; }
+
+  // height of a built toolbar, measured once, so an editor can keep the
+  // room free until it builds its own
+  int toolbarHeight();
+
+signals:
+  void canPasteChanged(bool canPaste);
+
+private slots:
+  void clipboardDataChanged();
+
+private:
+  explicit ToolbarResources(QObject* parent);
+
+  QStringList mFontSizes;
+  QHash<int, int> mFontSizeIndex;
+  QHash<QString, QIcon> mIcons;
+  QHash<QRgb, QIcon> mSwatches;
+  bool mCanPaste;
+  int mToolbarHeight = -1;
+};
+
+#endif // TOOLBARRESOURCES_H
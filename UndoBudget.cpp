@@ -0,0 +1,196 @@
+#include "stdafx.h"
+#include "UndoBudget.h"
+#include <QSet>
+#include <QTextBlock>
+#include <QTextDocument>
+#include <QTimer>
+#include "ImageStore.h"
+
+namespace {
+
+// calls f with the name of every image between position and end
+template <typename F>
+void forEachImage(QTextDocument* document, int position, int end, F f) {
+  for (QTextBlock block = document->findBlock(position); block.isValid() && block.position() < end;
+       block = block.next()) {
+    for (QTextBlock::iterator it = block.begin(); !it.atEnd(); ++it) {
+      const QTextFragment fragment = it.fragment();
+      if (fragment.position() >= end) break;
+      if (fragment.position() + fragment.length() <= position) continue;
+      const QTextCharFormat format = fragment.charFormat();
+      if (format.isImageFormat()) f(format.toImageFormat().name());
+    }
+  }
+}
+
+}
+
+UndoBudget::UndoBudget(QTextDocument* document, ImageStore* images, QObject* parent)
+  : QObject(parent), mDocument(document), mImages(images) {
+  connect(document, &QTextDocument::contentsChange, this, &UndoBudget::contentsChange);
+  connect(document, &QTextDocument::undoCommandAdded, this, &UndoBudget::commandAdded);
+}
+
+void UndoBudget::setBudget(qint64 bytes) {
+  mBudget = bytes;
+  enforce();
+}
+
+void UndoBudget::commandAdded() {
+  // emitted before the change of the command
+  mCommandAdded = true;
+  queueSync();
+}
+
+void UndoBudget::contentsChange(int position, int removed, int added) {
+  if (mEvicting || !mDocument->isUndoRedoEnabled()) return;
+  queueSync();
+  // an undo or redo replays a step charged already
+  if (follow() || mUndo.isEmpty()) return;
+  Step& step = mUndo.last();
+  // the removed text stays in the undo command, the added text for redo
+  const qint64 text = 2 * (qint64(removed) + added);
+  step.textBytes += text;
+  mTextBytes += text;
+  if (added > 0) {
+    forEachImage(mDocument, position, position + added, [this, &step](const QString& name) {
+      chargeImage(step, name);
+    });
+  }
+}
+
+void UndoBudget::queueSync() {
+  if (mSyncQueued) return;
+  mSyncQueued = true;
+  QTimer::singleShot(0, this, &UndoBudget::sync);
+}
+
+bool UndoBudget::follow() {
+  const int undo = mDocument->availableUndoSteps();
+  const int redo = mDocument->availableRedoSteps();
+  bool replayed = false;
+  if (mCommandAdded) {
+    // a new command drops what could be redone, even when the counts match
+    // those of a redo after an undo
+    mCommandAdded = false;
+    for (const Step& step : mRedo) release(step);
+    mRedo.clear();
+  } else {
+    while (mUndo.size() > undo && mRedo.size() < redo) {
+      mRedo.append(mUndo.takeLast());
+      replayed = true;
+    }
+    while (mRedo.size() > redo && mUndo.size() < undo) {
+      mUndo.append(mRedo.takeLast());
+      replayed = true;
+    }
+  }
+  // a change merged into the last command drops the redo steps, setHtml()
+  // and clearing drop all
+  while (mRedo.size() > redo) release(mRedo.takeLast());
+  while (mUndo.size() > undo) release(mUndo.takeFirst());
+  while (mUndo.size() < undo) mUndo.append(Step());
+  return replayed;
+}
+
+void UndoBudget::sync() {
+  mSyncQueued = false;
+  if (!mDocument->isUndoRedoEnabled()) return;
+  // catches clearing, which changes no contents
+  follow();
+  // images inserted while still encoding are in the store by now
+  if (mImages) {
+    for (auto it = mImageRefs.begin(); it != mImageRefs.end(); ++it) {
+      if (it->stored || !mImages->contains(it.key())) continue;
+      const qint64 bytes = mImages->bytes(it.key()).size();
+      mImageBytes += bytes - it->bytes;
+      it->bytes = bytes;
+      it->stored = true;
+    }
+  }
+  enforce();
+  emit memoryUsageChanged(memoryUsage());
+}
+
+void UndoBudget::chargeImage(Step& step, const QString& name) {
+  if (step.images.contains(name)) return;
+  step.images << name;
+  ImageRef& ref = mImageRefs[name];
+  if (ref.count++ > 0) return;
+  // a name outside the store, e.g. a data URI, holds the image itself
+  ref.stored = mImages && mImages->contains(name);
+  ref.bytes = ref.stored ? mImages->bytes(name).size() : qint64(name.size()) * 2;
+  mImageBytes += ref.bytes;
+}
+
+void UndoBudget::release(const Step& step) {
+  mTextBytes -= step.textBytes;
+  for (const QString& name : step.images) {
+    auto it = mImageRefs.find(name);
+    if (it == mImageRefs.end() || --it->count > 0) continue;
+    mImageBytes -= it->bytes;
+    mImageRefs.erase(it);
+  }
+}
+
+qint64 UndoBudget::cost(const Step& step) const {
+  // images shared with other steps count in each, erring on the safe side
+  qint64 bytes = step.textBytes;
+  for (const QString& name : step.images) bytes += mImageRefs.value(name).bytes;
+  return bytes;
+}
+
+void UndoBudget::enforce() {
+  if (mBudget <= 0 || memoryUsage() <= mBudget) return;
+  follow();
+  const bool modified = mDocument->isModified();
+  mEvicting = true;
+  bool dropped = false;
+  if (!mRedo.isEmpty()) {
+    mDocument->clearUndoRedoStacks(QTextDocument::RedoStack);
+    for (const Step& step : mRedo) release(step);
+    mRedo.clear();
+    dropped = true;
+  }
+  if (memoryUsage() > mBudget && !mUndo.isEmpty()) {
+    // the newest steps within half the budget, so this does not run again on
+    // the next step, and at least the last one
+    qint64 bytes = cost(mUndo.last());
+    int keep = 1;
+    while (keep < mUndo.size() && bytes + cost(mUndo[mUndo.size() - keep - 1]) <= mBudget / 2) {
+      bytes += cost(mUndo[mUndo.size() - keep - 1]);
+      ++keep;
+    }
+    if (keep < mUndo.size()) {
+      dropOldest(mUndo.size() - keep);
+      dropped = true;
+    }
+  }
+  mEvicting = false;
+  mDocument->setModified(modified);
+  if (!dropped) return;
+  pruneImages();
+  emit evicted();
+}
+
+void UndoBudget::dropOldest(int count) {
+  // QTextDocument drops no single commands: the steps to keep are undone,
+  // the undo stack cleared and they are redone. An undo takes a whole edit
+  // block, so a few more steps may stay than asked for.
+  while (mDocument->availableUndoSteps() > count) mDocument->undo();
+  mDocument->clearUndoRedoStacks(QTextDocument::UndoStack);
+  while (mDocument->availableRedoSteps() > 0) mDocument->redo();
+  const int dropped = mUndo.size() - mDocument->availableUndoSteps();
+  for (int i = 0; i < dropped; ++i) release(mUndo.takeFirst());
+}
+
+void UndoBudget::pruneImages() {
+  if (!mImages) return;
+  // images deleted from the text live on in the history only
+  QSet<QString> names;
+  for (auto it = mImageRefs.cbegin(); it != mImageRefs.cend(); ++it) names.insert(it.key());
+  forEachImage(mDocument, 0, mDocument->characterCount(), [&names](const QString& name) {
+    names.insert(name);
+  });
+  mImages->retain(names);
+}
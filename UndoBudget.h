@@ -0,0 +1,73 @@
+#ifndef UNDOBUDGET_H
+#define UNDOBUDGET_H
+
+#include <QHash>
+#include <QObject>
+#include <QStringList>
+#include <QVector>
+
+class QTextDocument;
+class ImageStore;
+
+// Keeps the undo history of a document within a memory budget. Every undo
+// step is charged for the characters it changed and for the images it
+// inserted; an image is charged once however many steps name it, as the
+// store holds a single copy. Over budget the redo steps go first, then the
+// oldest undo steps down to half the budget, the newest step always stays.
+// The images only the dropped steps referred to leave the store.
+class UndoBudget : public QObject {
+  Q_OBJECT
+public:
+  UndoBudget(QTextDocument* document, ImageStore* images = nullptr, QObject* parent = nullptr);
+
+  // bytes, 0 for no limit
+  void setBudget(qint64 bytes);
+  qint64 budget() const { return mBudget; }
+
+  // estimate of what the undo and redo steps hold
+  qint64 memoryUsage() const { return mTextBytes + mImageBytes; }
+
+signals:
+  void memoryUsageChanged(qint64 bytes);
+  void evicted();
+
+private slots:
+  void contentsChange(int position, int removed, int added);
+  void commandAdded();
+  void sync();
+
+private:
+  struct Step {
+    qint64 textBytes = 0;
+    QStringList images;
+  };
+
+  struct ImageRef {
+    int count = 0;
+    qint64 bytes = 0;     // as charged
+    bool stored = false;  // names still encoding or not in the store cost their length
+  };
+
+  void queueSync();
+  bool follow();
+  void chargeImage(Step& step, const QString& name);
+  void release(const Step& step);
+  qint64 cost(const Step& step) const;
+  void enforce();
+  void dropOldest(int count);
+  void pruneImages();
+
+  QTextDocument* mDocument;
+  ImageStore* mImages;
+  qint64 mBudget = 0;
+  QVector<Step> mUndo;          // oldest first, one per command of the document
+  QVector<Step> mRedo;          // next redo last
+  bool mCommandAdded = false;   // the next change is a new command, not a replay
+  bool mEvicting = false;
+  bool mSyncQueued = false;
+  QHash<QString, ImageRef> mImageRefs;
+  qint64 mTextBytes = 0;
+  qint64 mImageBytes = 0;
+};
+
+#endif // UNDOBUDGET_H
@@ -0,0 +1,489 @@
+#include <QApplication>
+#include <QBuffer>
+#include <QFile>
+#include <QSignalSpy>
+#include <QTemporaryDir>
+#include <QTextBlock>
+#include <QTextCursor>
+#include <QTextDocument>
+#include <QThreadPool>
+#include <QtTest>
+#include "corpus.h"
+#include "Autosave.h"
+#include "Base64.h"
+#include "DirectorySearch.h"
+#include "Finder.h"
+#include "HtmlHighlighter.h"
+#include "HtmlLexer.h"
+#include "HtmlLoader.h"
+#include "ImageEncoder.h"
+#include "Linkifier.h"
+#include "Replacer.h"
+#include "RichTextRenderer.h"
+#include "SearchIndex.h"
+#include "mrichtextedit.h"
+#include "mtextedit.h"
+#include "sourceeditor.h"
+#ifdef Q_OS_LINUX
+#include <unistd.h>
+#endif
+
+// Benchmarks of the editor library. Run headless, results come out in any
+// QtTest format, e.g. ./bench -o results.csv,csv or -o results.xml,xml.
+class Bench : public QObject {
+  Q_OBJECT
+
+private slots:
+  void toHtml_data() { documents(); }
+  void toHtml();
+  void writeHtml_data() { documents(); }
+  void writeHtml();
+  void setText_data() { documents(); }
+  void setText();
+  void loadHtml_data() { documents(); }
+  void loadHtml();
+  void linkifyAfterEdit_data() { documents(); }
+  void linkifyAfterEdit();
+  void sourceRoundTrip_data() { documents(); }
+  void sourceRoundTrip();
+  void cursorTraversal();
+  void autosave_data() { documents(); }
+  void autosave();
+  void construct_data() { toolbarModes(); }
+  void construct();
+  void constructMemory_data() { toolbarModes(); }
+  void constructMemory();
+  void undoMemory_data();
+  void undoMemory();
+  void render_data();
+  void render();
+
+  void highlight_data() { sources(); }
+  void highlight();
+  void lex_data() { sources(); }
+  void lex();
+
+  void find_data() { texts(); }
+  void find();
+  void directorySearch_data();
+  void directorySearch();
+  void indexFind_data();
+  void indexFind();
+  void replaceAll_data();
+  void replaceAll();
+  void replaceByReparse_data() { replaceAll_data(); }
+  void replaceByReparse();
+
+  void dropImage_data() { images(); }
+  void dropImage();
+  void encodeImage_data() { images(); }
+  void encodeImage();
+  void base64_data();
+  void base64();
+
+private:
+  void documents();
+  void sources();
+  void texts();
+  void images();
+  void toolbarModes();
+};
+
+namespace {
+
+// resident set of the process, 0 where /proc is not available
+qint64 residentBytes() {
+#ifdef Q_OS_LINUX
+  QFile statm("/proc/self/statm");
+  if (!statm.open(QIODevice::ReadOnly)) return 0;
+  const QList<QByteArray> fields = statm.readAll().split(' ');
+  return fields.size() > 1 ? fields[1].toLongLong() * sysconf(_SC_PAGESIZE) : 0;
+#else
+  return 0;
+#endif
+}
+
+}
+
+void Bench::documents() {
+  QTest::addColumn<QString>("html");
+  for (int paragraphs : { 100, 1000, 10000 }) {
+    QTest::newRow(qPrintable(QString("%1 paragraphs").arg(paragraphs))) << Corpus().html(paragraphs);
+  }
+  QTest::newRow("1000 paragraphs, 50 images") << Corpus().html(1000, 20);
+}
+
+void Bench::sources() {
+  QTest::addColumn<QString>("source");
+  for (int paragraphs : { 1000, 10000, 50000 }) {
+    QTextDocument document;
+    document.setHtml(Corpus().html(paragraphs));
+    QTest::newRow(qPrintable(QString("%1 paragraphs").arg(paragraphs))) << document.toHtml();
+  }
+  // minified pages put everything on one line
+  for (int size : { 100 * 1000, 1000 * 1000 }) {
+    QTest::newRow(qPrintable(QString("minified, %1 chars on one line").arg(size))) << Corpus().minified(size);
+  }
+}
+
+void Bench::texts() {
+  QTest::addColumn<QString>("text");
+  for (int size : { 100 * 1000, 1000 * 1000, 10 * 1000 * 1000 }) {
+    QTest::newRow(qPrintable(QString("%1 chars").arg(size))) << Corpus().text(size);
+  }
+}
+
+void Bench::images() {
+  QTest::addColumn<QImage>("image");
+  QTest::newRow("640x480") << Corpus().image(640, 480);
+  QTest::newRow("1920x1080") << Corpus().image(1920, 1080);
+  QTest::newRow("5472x3648") << Corpus().image(5472, 3648);
+}
+
+void Bench::toolbarModes() {
+  QTest::addColumn<int>("mode");
+  QTest::newRow("embedded toolbar") << int(MRichTextEdit::ToolbarEmbedded);
+  QTest::newRow("toolbar on focus") << int(MRichTextEdit::ToolbarOnFocus);
+}
+
+void Bench::toHtml() {
+  QFETCH(QString, html);
+  MRichTextEdit edit;
+  edit.setText(html, true);
+  QBENCHMARK {
+    edit.toHtml();
+  }
+}
+
+void Bench::writeHtml() {
+  QFETCH(QString, html);
+  MRichTextEdit edit;
+  edit.setText(html, true);
+  QBuffer buffer;
+  buffer.open(QIODevice::WriteOnly);
+  QBENCHMARK {
+    buffer.seek(0);
+    edit.writeHtml(&buffer);
+  }
+}
+
+void Bench::setText() {
+  QFETCH(QString, html);
+  MRichTextEdit edit;
+  QBENCHMARK {
+    edit.setText(html, true);
+  }
+}
+
+void Bench::loadHtml() {
+  QFETCH(QString, html);
+  const QByteArray bytes = html.toUtf8();
+  MRichTextEdit edit;
+  QBENCHMARK {
+    QBuffer buffer;
+    buffer.setData(bytes);
+    buffer.open(QIODevice::ReadOnly);
+    HtmlLoader* loader = edit.loadHtml(&buffer);
+    QSignalSpy finished(loader, &HtmlLoader::finished);
+    QVERIFY(finished.wait(60000));
+  }
+}
+
+void Bench::linkifyAfterEdit() {
+  QFETCH(QString, html);
+  QTextDocument document;
+  document.setHtml(html);
+  Linkifier linkifier(&document);
+  for (QTextBlock block = document.begin(); block.isValid(); block = block.next()) linkifier.links(block);
+  QTextCursor cursor(document.findBlockByNumber(document.blockCount() / 2));
+  QBENCHMARK {
+    cursor.insertText("x");
+    for (QTextBlock block = document.begin(); block.isValid(); block = block.next()) linkifier.links(block);
+  }
+}
+
+void Bench::sourceRoundTrip() {
+  QFETCH(QString, html);
+  MRichTextEdit edit;
+  edit.setText(html, true);
+  QBENCHMARK {
+    SourceEditor source(&edit);
+    source.done(QDialog::Accepted);
+    edit.setText(edit.toHtml(), true);
+  }
+}
+
+void Bench::cursorTraversal() {
+  // every move updates the toolbar from the char format and list under the cursor
+  MRichTextEdit edit;
+  edit.setText(Corpus().html(100000), true);
+  QTextCursor cursor(edit.document());
+  QBENCHMARK {
+    cursor.movePosition(QTextCursor::Start);
+    edit.setTextCursor(cursor);
+    while (cursor.movePosition(QTextCursor::NextBlock)) edit.setTextCursor(cursor);
+  }
+}
+
+void Bench::autosave() {
+  // GUI thread part of a save after an edit, the same for any document size
+  QFETCH(QString, html);
+  QTemporaryDir dir;
+  MRichTextEdit edit;
+  edit.setText(html, true);
+  Autosave* autosave = edit.startAutosave(dir.filePath("autosave.html"));
+  autosave->setInterval(0);
+  QTextCursor cursor(edit.document()->findBlockByNumber(edit.document()->blockCount() / 2));
+  QBENCHMARK {
+    cursor.insertText("x");
+    autosave->save();
+  }
+
+  // the snapshot and its journal give the document back, images included
+  cursor.insertHtml(edit.absorbImages("<b>bold</b> <img src=\"data:image/png;base64,"
+                                      + QLatin1String(Corpus(7).png(32, 32).toBase64()) + "\" />"));
+  const QString expected = edit.toPlainText();
+  delete autosave;
+  QTextDocument recovered;
+  ImageStore images;
+  QVERIFY(Autosave::recover(dir.filePath("autosave.html"), &recovered, &images));
+  QCOMPARE(recovered.toPlainText(), expected);
+  for (QTextBlock block = recovered.begin(); block.isValid(); block = block.next()) {
+    for (QTextBlock::iterator it = block.begin(); !it.atEnd(); ++it) {
+      const QTextCharFormat format = it.fragment().charFormat();
+      if (format.isImageFormat()) QVERIFY(images.contains(format.toImageFormat().name()));
+    }
+  }
+}
+
+void Bench::construct() {
+  QFETCH(int, mode);
+  // process-wide toolbar resources are made by the first editor
+  MRichTextEdit first;
+  QBENCHMARK {
+    MRichTextEdit edit(MRichTextEdit::ToolbarMode(mode));
+  }
+}
+
+void Bench::constructMemory() {
+  QFETCH(int, mode);
+  if (!residentBytes()) QSKIP("no /proc/self/statm");
+  const int count = 200;
+  QWidget form;
+  new MRichTextEdit(&form);
+  const qint64 before = residentBytes();
+  for (int i = 0; i < count; ++i) new MRichTextEdit(MRichTextEdit::ToolbarMode(mode), &form);
+  QTest::setBenchmarkResult(qreal(residentBytes() - before) / count, QTest::BytesAllocated);
+}
+
+void Bench::undoMemory_data() {
+  QTest::addColumn<qint64>("budget");
+  QTest::newRow("unbounded history") << qint64(0);
+  QTest::newRow("16 MB budget") << qint64(16 * 1024 * 1024);
+}
+
+void Bench::undoMemory() {
+  QFETCH(qint64, budget);
+  MTextEdit edit(nullptr);
+  edit.setUndoBudget(budget);
+  // every image is pasted, typed after and deleted again, so only the
+  // history holds it
+  for (int i = 0; i < 40; ++i) {
+    QSignalSpy ready(&edit, &MTextEdit::imageReady);
+    edit.dropImage(Corpus(i + 1).image(1920, 1080), "PNG");
+    QVERIFY(ready.wait(60000));
+    edit.insertPlainText(Corpus(i + 1).text(200));
+    edit.selectAll();
+    edit.textCursor().removeSelectedText();
+    QCoreApplication::processEvents();
+  }
+  QTest::setBenchmarkResult(qreal(edit.undoMemory() + edit.imageStore()->memoryUsage()), QTest::BytesAllocated);
+}
+
+void Bench::render_data() {
+  QTest::addColumn<bool>("cached");
+  QTest::newRow("1000 snippets, laid out and drawn") << false;
+  QTest::newRow("1000 snippets, from the cache") << true;
+}
+
+void Bench::render() {
+  QFETCH(bool, cached);
+  QStringList snippets;
+  for (int i = 0; i < 1000; ++i) snippets << Corpus(i + 1).html(3);
+  RichTextRenderer renderer(256 * 1024 * 1024);
+  for (const QString& html : snippets) renderer.render(html, 400, 1, Qt::black);
+  QBENCHMARK {
+    if (!cached) renderer.clear();
+    for (const QString& html : snippets) renderer.render(html, 400, 1, Qt::black);
+  }
+}
+
+void Bench::highlight() {
+  QFETCH(QString, source);
+  QTextDocument document;
+  document.setPlainText(source);
+  HtmlHighlighter highlighter(&document);
+  QBENCHMARK {
+    highlighter.rehighlight();
+  }
+}
+
+void Bench::lex() {
+  QFETCH(QString, source);
+  const QStringList lines = source.split('\n');
+  int runs = 0;
+  QBENCHMARK {
+    int state = HtmlLexer::NormalState;
+    for (const QString& line : lines) {
+      state = HtmlLexer::lex(line, state, [&runs](int, int, HtmlLexer::Construct) { ++runs; });
+    }
+  }
+  QVERIFY(runs > 0);
+}
+
+void Bench::find() {
+  QFETCH(QString, text);
+  Finder finder(text);
+  QBENCHMARK {
+    finder.find("paragraph");
+  }
+}
+
+void Bench::directorySearch_data() {
+  QTest::addColumn<QString>("query");
+  QTest::addColumn<int>("hits");
+  // every file holds one "Éditeur" line among generated text
+  QTest::newRow("without the accent") << "EDITEUR" << 0;
+  QTest::newRow("non-ascii, same case") << QString::fromUtf8("Éditeur") << 50;
+  QTest::newRow("non-ascii, ascii in other case") << QString::fromUtf8("ÉDITEUR") << 50;
+  QTest::newRow("non-ascii, other case") << QString::fromUtf8("éditeur") << 0;
+}
+
+void Bench::directorySearch() {
+  QFETCH(QString, query);
+  QFETCH(int, hits);
+  QTemporaryDir dir;
+  for (int i = 0; i < 50; ++i) {
+    QFile file(dir.filePath(QString("%1.html").arg(i)));
+    QVERIFY(file.open(QIODevice::WriteOnly));
+    Corpus corpus(i + 1);
+    file.write(corpus.text(500 * 1000).toUtf8());
+    file.write(QString::fromUtf8("\nÉditeur\n").toUtf8());
+    file.write(corpus.text(500 * 1000).toUtf8());
+  }
+  DirectorySearch search;
+  int found = 0;
+  connect(&search, &DirectorySearch::hitsFound, [&found](const DirectorySearch::Hits& h) { found += h.size(); });
+  QBENCHMARK {
+    found = 0;
+    QSignalSpy finished(&search, &DirectorySearch::finished);
+    search.start(dir.path(), query);
+    QVERIFY(finished.wait(60000));
+  }
+  QCOMPARE(found, hits);
+}
+
+void Bench::indexFind_data() {
+  documents();
+  QTest::newRow("100000 paragraphs") << Corpus().html(100000);
+}
+
+void Bench::indexFind() {
+  QFETCH(QString, html);
+  QTextDocument document;
+  document.setHtml(html);
+  SearchIndex index(&document);
+  QBENCHMARK {
+    index.find("paragraph");
+  }
+  QVERIFY(index.memoryUsage() > 0);
+  qInfo("index memory: %lld bytes for %d blocks", index.memoryUsage(), document.blockCount());
+}
+
+void Bench::replaceAll_data() {
+  documents();
+  QTest::newRow("100000 matches") << Corpus().matches("gamma", 100000);
+}
+
+void Bench::replaceAll() {
+  QFETCH(QString, html);
+  QTextDocument document;
+  document.setHtml(html);
+  Replacer replacer(&document);
+  QBENCHMARK {
+    replacer.replaceAll("gamma", "omega");
+    replacer.replaceAll("omega", "gamma");
+  }
+}
+
+// what replacing did before Replacer: the source replaced and loaded again,
+// losing the undo history on the way
+void Bench::replaceByReparse() {
+  QFETCH(QString, html);
+  MRichTextEdit edit;
+  edit.setText(html, true);
+  QBENCHMARK {
+    edit.setText(edit.toHtml().replace("gamma", "omega"), true);
+    edit.setText(edit.toHtml().replace("omega", "gamma"), true);
+  }
+}
+
+void Bench::dropImage() {
+  QFETCH(QImage, image);
+  MTextEdit edit(nullptr);
+  // the time until the image is in the store, encoding included
+  QBENCHMARK {
+    QSignalSpy ready(&edit, &MTextEdit::imageReady);
+    edit.dropImage(image, "PNG");
+    QVERIFY(ready.wait(60000));
+  }
+}
+
+void Bench::encodeImage() {
+  QFETCH(QImage, image);
+  QBENCHMARK {
+    ImageEncoder::encode(image, "PNG");
+  }
+}
+
+void Bench::base64_data() {
+  QTest::addColumn<QByteArray>("bytes");
+  QTest::addColumn<bool>("legacy");
+  for (int size : { 1024 * 1024, 10 * 1024 * 1024 }) {
+    const QByteArray bytes = Corpus().bytes(size);
+    QTest::newRow(qPrintable(QString("%1 MB, former loop").arg(size >> 20))) << bytes << true;
+    QTest::newRow(qPrintable(QString("%1 MB, Base64").arg(size >> 20))) << bytes << false;
+  }
+}
+
+void Bench::base64() {
+  QFETCH(QByteArray, bytes);
+  QFETCH(bool, legacy);
+  if (legacy) {
+    // what MTextEdit::dropImage used to do
+    QBENCHMARK {
+      QByteArray base64 = bytes.toBase64();
+      QByteArray base64l;
+      for (int i = 0; i < base64.size(); i++) {
+        base64l.append(base64[i]);
+        if (i % 80 == 0) base64l.append("\n");
+      }
+    }
+  } else {
+    QBENCHMARK {
+      Base64::encode(bytes, 80);
+    }
+  }
+}
+
+int main(int argc, char* argv[]) {
+  // no display needed
+  if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) qputenv("QT_QPA_PLATFORM", "offscreen");
+  QApplication app(argc, argv);
+  Bench bench;
+  const int result = QTest::qExec(&bench, argc, argv);
+  QThreadPool::globalInstance()->waitForDone();
+  return result;
+}
+
+#include "bench.moc"
@@ -0,0 +1,13 @@
+# Benchmarks of the editor library, run without a display:
+#   qmake && make && ./bench -o results.csv,csv
+
+TEMPLATE = app
+TARGET = bench
+QT += testlib
+CONFIG += console testcase
+CONFIG -= app_bundle
+
+include(../htmleditor.pri)
+
+HEADERS += corpus.h
+SOURCES += bench.cpp
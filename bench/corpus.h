@@ -0,0 +1,135 @@
+#ifndef CORPUS_H
+#define CORPUS_H
+
+#include <QBuffer>
+#include <QByteArray>
+#include <QColor>
+#include <QImage>
+#include <QString>
+#include <QStringList>
+
+// Documents of a controlled size for the benchmarks. The same arguments
+// always give the same output.
+class Corpus {
+public:
+  explicit Corpus(uint seed = 1) : mState(seed) {}
+
+  QString word() {
+    static const char* const words[] = {
+      "alpha", "beta", "gamma", "delta", "lorem", "ipsum", "dolor", "sit", "amet",
+      "editor", "document", "paragraph", "format", "image", "table", "search"
+    };
+    return QLatin1String(words[next() % (sizeof(words) / sizeof(words[0]))]);
+  }
+
+  QString sentence(int words) {
+    QStringList list;
+    for (int i = 0; i < words; ++i) list << word();
+    return list.join(' ');
+  }
+
+  // plain text of about this many characters
+  QString text(int size) {
+    QString result;
+    result.reserve(size + 16);
+    while (result.size() < size) {
+      result += sentence(12);
+      result += next() % 8 ? QLatin1String(". ") : QLatin1String(".\n");
+    }
+    result.truncate(size);
+    return result;
+  }
+
+  // body of rich HTML: formatted paragraphs with links, a list every 20
+  // paragraphs and, when imageEvery > 0, a small embedded PNG that often
+  QString html(int paragraphs, int imageEvery = 0) {
+    QString body;
+    for (int i = 0; i < paragraphs; ++i) {
+      if (i % 20 == 19) {
+        body += "<ul>";
+        for (int j = 0; j < 3; ++j) body += "<li>" + sentence(6) + "</li>";
+        body += "</ul>\n";
+        continue;
+      }
+      body += "<p>" + sentence(8) + " <b>" + sentence(3) + "</b> " + sentence(6);
+      if (i % 5 == 0) body += " http://example.com/" + word() + " and " + word() + "@example.com";
+      body += " <i>" + sentence(4) + "</i>";
+      if (imageEvery > 0 && i % imageEvery == 0) {
+        body += " <img src=\"data:image/png;base64," + QLatin1String(png(64, 48).toBase64()) + "\" />";
+      }
+      body += "</p>\n";
+    }
+    return "<html><head></head><body>\n" + body + "</body></html>";
+  }
+
+  // a page as minifiers write it, on a single line of about size
+  // characters: tags with quoted attributes, entities and comments
+  QString minified(int size) {
+    QString result = "<!DOCTYPE html><html><head><title>" + word() + "</title></head><body>";
+    while (result.size() < size) {
+      switch (next() % 4) {
+      case 0:
+        result += "<div class=\"" + word() + ' ' + word() + "\" id=\"" + word() + "\">" + sentence(6) + "</div>";
+        break;
+      case 1:
+        result += "<a href=\"http://example.com/" + word() + "?a=1&amp;b=2\" title='" + word() + "'>" + sentence(2) + "</a>";
+        break;
+      case 2:
+        result += "<p>" + sentence(5) + " &copy; &#169; &lt;" + word() + "&gt;</p>";
+        break;
+      default:
+        result += "<!--" + sentence(3) + "--><span style=\"color:#" + QString::number(next() % 0xffffff, 16) + "\">"
+            + word() + "</span>";
+      }
+    }
+    return result + "</body></html>";
+  }
+
+  // rich HTML holding word exactly count times, ten per paragraph between
+  // filler text that never contains it
+  QString matches(const QString& word, int count) {
+    QString body;
+    for (int i = 0; i < count; i += 10) {
+      body += "<p>";
+      for (int j = 0; j < 10 && i + j < count; ++j) body += "lorem ipsum dolor <b>" + word + "</b> sit amet ";
+      body += "</p>\n";
+    }
+    return "<html><head></head><body>\n" + body + "</body></html>";
+  }
+
+  QImage image(int width, int height) {
+    QImage result(width, height, QImage::Format_RGB32);
+    for (int y = 0; y < height; ++y) {
+      QRgb* line = reinterpret_cast<QRgb*>(result.scanLine(y));
+      for (int x = 0; x < width; ++x) {
+        // gradient with some noise, compresses like a photo rather than a flat fill
+        line[x] = qRgb((x * 255 / width + int(next() % 16)) & 0xff, y * 255 / height, (x + y) & 0xff);
+      }
+    }
+    return result;
+  }
+
+  QByteArray png(int width, int height) {
+    QByteArray bytes;
+    QBuffer buffer(&bytes);
+    buffer.open(QIODevice::WriteOnly);
+    image(width, height).save(&buffer, "PNG");
+    return bytes;
+  }
+
+  QByteArray bytes(int size) {
+    QByteArray result(size, Qt::Uninitialized);
+    for (int i = 0; i < size; ++i) result[i] = char(next());
+    return result;
+  }
+
+private:
+  uint next() {
+    mState = mState * 1103515245u + 12345u;
+    return mState >> 16;
+  }
+
+  uint mState;
+};
+
+#endif // CORPUS_H
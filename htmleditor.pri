@@ -0,0 +1,71 @@
+# Sources of the editor library, shared by htmleditor.pro and the benchmarks.
+
+QT += core gui widgets
+CONFIG += c++11
+
+INCLUDEPATH += $$PWD
+DEPENDPATH += $$PWD
+
+HEADERS += \
+    $$PWD/Autosave.h \
+    $$PWD/Base64.h \
+    $$PWD/BlockCache.h \
+    $$PWD/DirectorySearch.h \
+    $$PWD/Finder.h \
+    $$PWD/FormatRemover.h \
+    $$PWD/Global.h \
+    $$PWD/HtmlHighlighter.h \
+    $$PWD/HtmlLexer.h \
+    $$PWD/HtmlLexWorker.h \
+    $$PWD/HtmlLoader.h \
+    $$PWD/HtmlWriter.h \
+    $$PWD/ImageEncoder.h \
+    $$PWD/ImageStore.h \
+    $$PWD/Linkifier.h \
+    $$PWD/MultiFinder.h \
+    $$PWD/Replacer.h \
+    $$PWD/RichTextRenderer.h \
+    $$PWD/RichTextView.h \
+    $$PWD/SearchIndex.h \
+    $$PWD/SearchWidget.h \
+    $$PWD/SourceView.h \
+    $$PWD/Timing.h \
+    $$PWD/ToolbarResources.h \
+    $$PWD/UndoBudget.h \
+    $$PWD/mrichtextedit.h \
+    $$PWD/mtextedit.h \
+    $$PWD/sourceeditor.h \
+    $$PWD/stdafx.h
+
+SOURCES += \
+    $$PWD/Autosave.cpp \
+    $$PWD/Base64.cpp \
+    $$PWD/DirectorySearch.cpp \
+    $$PWD/Finder.cpp \
+    $$PWD/FormatRemover.cpp \
+    $$PWD/HtmlHighlighter.cpp \
+    $$PWD/HtmlLexWorker.cpp \
+    $$PWD/HtmlLoader.cpp \
+    $$PWD/HtmlWriter.cpp \
+    $$PWD/ImageEncoder.cpp \
+    $$PWD/ImageStore.cpp \
+    $$PWD/Linkifier.cpp \
+    $$PWD/MultiFinder.cpp \
+    $$PWD/Replacer.cpp \
+    $$PWD/RichTextRenderer.cpp \
+    $$PWD/RichTextView.cpp \
+    $$PWD/SearchIndex.cpp \
+    $$PWD/SearchWidget.cpp \
+    $$PWD/SourceView.cpp \
+    $$PWD/Timing.cpp \
+    $$PWD/ToolbarResources.cpp \
+    $$PWD/UndoBudget.cpp \
+    $$PWD/mrichtextedit.cpp \
+    $$PWD/mtextedit.cpp \
+    $$PWD/sourceeditor.cpp
+
+FORMS += \
+    $$PWD/mrichtextedit.ui \
+    $$PWD/richtexttoolbar.ui
+
+DEFINES += HTMLEDITOR_LIB BUILD_STATIC
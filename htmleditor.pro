@@ -0,0 +1,8 @@
+# qmake build of the editor library for platforms without Visual Studio.
+#   qmake && make
+
+TEMPLATE = lib
+TARGET = htmleditor
+CONFIG += staticlib
+
+include(htmleditor.pri)
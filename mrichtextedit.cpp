@@ -24,9 +24,6 @@
 #include "stdafx.h"
 #include "mrichtextedit.h"
 #include <QApplication>
-#include <QClipboard>
-#include <QMimeData>
-#include <QFontDatabase>
 #include <QInputDialog>
 #include <QColorDialog>
 #include <QTextList>
@@ -40,29 +37,85 @@
 #include <QMenu>
 #include <QDialog>
 #include "ui_mrichtextedit.h"
+#include "ui_richtexttoolbar.h"
 #include "sourceeditor.h"
+#include "Linkifier.h"
+#include "HtmlWriter.h"
+#include "HtmlLoader.h"
+#include "Timing.h"
+#include "FormatRemover.h"
+#include "ToolbarResources.h"
+#include "Autosave.h"
 
 
 MRichTextEdit::MRichTextEdit(QWidget *parent) 
-    : QWidget(parent), ui_(new Ui::MRichTextEdit){
+    : MRichTextEdit(ToolbarEmbedded, parent) {
+}
+
+MRichTextEdit::MRichTextEdit(ToolbarMode mode, QWidget *parent)
+    : QWidget(parent), m_toolbarMode(mode), ui_(new Ui::MRichTextEdit){
     ui_->setupUi(this);
 
-    m_lastBlockList = 0;
+    m_linkifier = new Linkifier(ui_->f_textedit->document(), this);
     ui_->f_textedit->setTabStopWidth(40);
 
     connect(ui_->f_textedit, &MTextEdit::textChanged, this, &MRichTextEdit::textChanged);
-    connect(ui_->f_textedit, SIGNAL(currentCharFormatChanged(QTextCharFormat)),
-        this, SLOT(slotCurrentCharFormatChanged(QTextCharFormat)));
-    connect(ui_->f_textedit, SIGNAL(cursorPositionChanged()),
-        this, SLOT(slotCursorPositionChanged()));
 
     m_fontsize_h1 = 18;
     m_fontsize_h2 = 16;
     m_fontsize_h3 = 14;
     m_fontsize_h4 = 12;
 
-    fontChanged(ui_->f_textedit->font());
-    bgColorChanged(ui_->f_textedit->textColor());
+    if (mode == ToolbarEmbedded) {
+        createToolbar();
+    }
+    else {
+        // built when the editor first gets focus, in room kept free for it
+        // so the text does not move then
+        m_toolbarSpace = new QWidget(this);
+        m_toolbarSpace->setFixedHeight(ToolbarResources::instance()->toolbarHeight());
+        ui_->verticalLayout->insertWidget(0, m_toolbarSpace);
+        ui_->f_textedit->installEventFilter(this);
+    }
+}
+
+MRichTextEdit::~MRichTextEdit() {
+    delete tb_;
+    delete ui_;
+}
+
+void MRichTextEdit::ensureToolbar() {
+    if (!tb_) {
+        ui_->f_textedit->removeEventFilter(this);
+        createToolbar();
+    }
+}
+
+bool MRichTextEdit::eventFilter(QObject *watched, QEvent *event) {
+    if (watched == ui_->f_textedit && event->type() == QEvent::FocusIn) {
+        ensureToolbar();
+    }
+    return QWidget::eventFilter(watched, event);
+}
+
+void MRichTextEdit::createToolbar() {
+    ToolbarResources *resources = ToolbarResources::instance();
+    QWidget *toolbar = new QWidget(this);
+    toolbar->setObjectName("f_toolbar");
+    tb_ = new Ui::RichTextToolbar;
+    tb_->setupUi(toolbar);
+    if (m_toolbarSpace) {
+        delete ui_->verticalLayout->replaceWidget(m_toolbarSpace, toolbar);
+        delete m_toolbarSpace;
+        m_toolbarSpace = nullptr;
+    } else {
+        ui_->verticalLayout->insertWidget(0, toolbar);
+    }
+
+    connect(ui_->f_textedit, SIGNAL(currentCharFormatChanged(QTextCharFormat)),
+        this, SLOT(slotCurrentCharFormatChanged(QTextCharFormat)));
+    connect(ui_->f_textedit, SIGNAL(cursorPositionChanged()),
+        this, SLOT(slotCursorPositionChanged()));
 
     // paragraph formatting
 
@@ -72,63 +125,72 @@ MRichTextEdit::MRichTextEdit(QWidget *parent)
         << tr("Heading 3")
         << tr("Heading 4")
         << tr("Monospace");
-    ui_->f_paragraph->addItems(m_paragraphItems);
+    tb_->f_paragraph->addItems(m_paragraphItems);
 
-    connect(ui_->f_paragraph, SIGNAL(activated(int)),
+    connect(tb_->f_paragraph, SIGNAL(activated(int)),
         this, SLOT(textStyle(int)));
 
     // undo & redo
 
-    ui_->f_undo->setShortcut(QKeySequence::Undo);
-    ui_->f_redo->setShortcut(QKeySequence::Redo);
+    tb_->f_undo->setIcon(resources->icon("edit-undo"));
+    tb_->f_redo->setIcon(resources->icon("edit-redo"));
+    tb_->f_undo->setShortcut(QKeySequence::Undo);
+    tb_->f_redo->setShortcut(QKeySequence::Redo);
 
     connect(ui_->f_textedit->document(), SIGNAL(undoAvailable(bool)),
-        ui_->f_undo, SLOT(setEnabled(bool)));
+        tb_->f_undo, SLOT(setEnabled(bool)));
     connect(ui_->f_textedit->document(), SIGNAL(redoAvailable(bool)),
-        ui_->f_redo, SLOT(setEnabled(bool)));
+        tb_->f_redo, SLOT(setEnabled(bool)));
 
-    ui_->f_undo->setEnabled(ui_->f_textedit->document()->isUndoAvailable());
-    ui_->f_redo->setEnabled(ui_->f_textedit->document()->isRedoAvailable());
+    tb_->f_undo->setEnabled(ui_->f_textedit->document()->isUndoAvailable());
+    tb_->f_redo->setEnabled(ui_->f_textedit->document()->isRedoAvailable());
 
-    connect(ui_->f_undo, SIGNAL(clicked()), ui_->f_textedit, SLOT(undo()));
-    connect(ui_->f_redo, SIGNAL(clicked()), ui_->f_textedit, SLOT(redo()));
+    connect(tb_->f_undo, SIGNAL(clicked()), ui_->f_textedit, SLOT(undo()));
+    connect(tb_->f_redo, SIGNAL(clicked()), ui_->f_textedit, SLOT(redo()));
 
     // cut, copy & paste
 
-    ui_->f_cut->setShortcut(QKeySequence::Cut);
-    ui_->f_copy->setShortcut(QKeySequence::Copy);
-    ui_->f_paste->setShortcut(QKeySequence::Paste);
+    tb_->f_cut->setIcon(resources->icon("edit-cut"));
+    tb_->f_copy->setIcon(resources->icon("edit-copy"));
+    tb_->f_paste->setIcon(resources->icon("edit-paste"));
+    tb_->f_cut->setShortcut(QKeySequence::Cut);
+    tb_->f_copy->setShortcut(QKeySequence::Copy);
+    tb_->f_paste->setShortcut(QKeySequence::Paste);
 
-    ui_->f_cut->setEnabled(false);
-    ui_->f_copy->setEnabled(false);
+    const bool selection = ui_->f_textedit->textCursor().hasSelection();
+    tb_->f_cut->setEnabled(selection);
+    tb_->f_copy->setEnabled(selection);
+    tb_->f_paste->setEnabled(resources->canPaste());
 
-    connect(ui_->f_cut, SIGNAL(clicked()), ui_->f_textedit, SLOT(cut()));
-    connect(ui_->f_copy, SIGNAL(clicked()), ui_->f_textedit, SLOT(copy()));
-    connect(ui_->f_paste, SIGNAL(clicked()), ui_->f_textedit, SLOT(paste()));
+    connect(tb_->f_cut, SIGNAL(clicked()), ui_->f_textedit, SLOT(cut()));
+    connect(tb_->f_copy, SIGNAL(clicked()), ui_->f_textedit, SLOT(copy()));
+    connect(tb_->f_paste, SIGNAL(clicked()), ui_->f_textedit, SLOT(paste()));
 
-    connect(ui_->f_textedit, SIGNAL(copyAvailable(bool)), ui_->f_cut, SLOT(setEnabled(bool)));
-    connect(ui_->f_textedit, SIGNAL(copyAvailable(bool)), ui_->f_copy, SLOT(setEnabled(bool)));
+    connect(ui_->f_textedit, SIGNAL(copyAvailable(bool)), tb_->f_cut, SLOT(setEnabled(bool)));
+    connect(ui_->f_textedit, SIGNAL(copyAvailable(bool)), tb_->f_copy, SLOT(setEnabled(bool)));
 
-#ifndef QT_NO_CLIPBOARD
-    connect(QApplication::clipboard(), SIGNAL(dataChanged()), this, SLOT(slotClipboardDataChanged()));
-#endif
+    connect(resources, &ToolbarResources::canPasteChanged, this, &MRichTextEdit::slotClipboardDataChanged);
 
     // link
 
-    ui_->f_link->setShortcut(Qt::CTRL + Qt::Key_L);
+    tb_->f_link->setIcon(resources->icon("applications-internet"));
+    tb_->f_link->setShortcut(Qt::CTRL + Qt::Key_L);
 
-    connect(ui_->f_link, SIGNAL(clicked(bool)), this, SLOT(textLink(bool)));
+    connect(tb_->f_link, SIGNAL(clicked(bool)), this, SLOT(textLink(bool)));
 
     // bold, italic & underline
 
-    ui_->f_bold->setShortcut(Qt::CTRL + Qt::Key_B);
-    ui_->f_italic->setShortcut(Qt::CTRL + Qt::Key_I);
-    ui_->f_underline->setShortcut(Qt::CTRL + Qt::Key_U);
+    tb_->f_bold->setIcon(resources->icon("format-text-bold"));
+    tb_->f_italic->setIcon(resources->icon("format-text-italic"));
+    tb_->f_underline->setIcon(resources->icon("format-text-underline"));
+    tb_->f_bold->setShortcut(Qt::CTRL + Qt::Key_B);
+    tb_->f_italic->setShortcut(Qt::CTRL + Qt::Key_I);
+    tb_->f_underline->setShortcut(Qt::CTRL + Qt::Key_U);
 
-    connect(ui_->f_bold, SIGNAL(clicked()), this, SLOT(textBold()));
-    connect(ui_->f_italic, SIGNAL(clicked()), this, SLOT(textItalic()));
-    connect(ui_->f_underline, SIGNAL(clicked()), this, SLOT(textUnderline()));
-    connect(ui_->f_strikeout, SIGNAL(clicked()), this, SLOT(textStrikeout()));
+    connect(tb_->f_bold, SIGNAL(clicked()), this, SLOT(textBold()));
+    connect(tb_->f_italic, SIGNAL(clicked()), this, SLOT(textItalic()));
+    connect(tb_->f_underline, SIGNAL(clicked()), this, SLOT(textUnderline()));
+    connect(tb_->f_strikeout, SIGNAL(clicked()), this, SLOT(textStrikeout()));
 
     QAction *removeFormat = new QAction(tr("Remove character formatting"), this);
     removeFormat->setShortcut(QKeySequence("CTRL+M"));
@@ -148,53 +210,48 @@ MRichTextEdit::MRichTextEdit(QWidget *parent)
     menu->addAction(removeAllFormat);
     menu->addAction(removeFormat);
     menu->addAction(textsource);
-    ui_->f_menu->setMenu(menu);
-    ui_->f_menu->setPopupMode(QToolButton::InstantPopup);
+    tb_->f_menu->setMenu(menu);
+    tb_->f_menu->setPopupMode(QToolButton::InstantPopup);
 
     // lists
 
-    ui_->f_list_bullet->setShortcut(Qt::CTRL + Qt::Key_Minus);
-    ui_->f_list_ordered->setShortcut(Qt::CTRL + Qt::Key_Equal);
+    tb_->f_list_bullet->setShortcut(Qt::CTRL + Qt::Key_Minus);
+    tb_->f_list_ordered->setShortcut(Qt::CTRL + Qt::Key_Equal);
 
-    connect(ui_->f_list_bullet, SIGNAL(clicked(bool)), this, SLOT(listBullet(bool)));
-    connect(ui_->f_list_ordered, SIGNAL(clicked(bool)), this, SLOT(listOrdered(bool)));
+    connect(tb_->f_list_bullet, SIGNAL(clicked(bool)), this, SLOT(listBullet(bool)));
+    connect(tb_->f_list_ordered, SIGNAL(clicked(bool)), this, SLOT(listOrdered(bool)));
 
     // indentation
 
-    ui_->f_indent_dec->setShortcut(Qt::CTRL + Qt::Key_Comma);
-    ui_->f_indent_inc->setShortcut(Qt::CTRL + Qt::Key_Period);
+    tb_->f_indent_dec->setIcon(resources->icon("format-indent-less"));
+    tb_->f_indent_inc->setIcon(resources->icon("format-indent-more"));
+    tb_->f_indent_dec->setShortcut(Qt::CTRL + Qt::Key_Comma);
+    tb_->f_indent_inc->setShortcut(Qt::CTRL + Qt::Key_Period);
 
-    connect(ui_->f_indent_inc, SIGNAL(clicked()), this, SLOT(increaseIndentation()));
-    connect(ui_->f_indent_dec, SIGNAL(clicked()), this, SLOT(decreaseIndentation()));
+    connect(tb_->f_indent_inc, SIGNAL(clicked()), this, SLOT(increaseIndentation()));
+    connect(tb_->f_indent_dec, SIGNAL(clicked()), this, SLOT(decreaseIndentation()));
 
     // font size
 
-    QFontDatabase db;
-    foreach(int size, db.standardSizes())
-        ui_->f_fontsize->addItem(QString::number(size));
+    tb_->f_fontsize->addItems(resources->fontSizes());
 
-    connect(ui_->f_fontsize, SIGNAL(activated(QString)),
+    connect(tb_->f_fontsize, SIGNAL(activated(QString)),
         this, SLOT(textSize(QString)));
-    ui_->f_fontsize->setCurrentIndex(ui_->f_fontsize->findText(QString::number(QApplication::font()
-        .pointSize())));
-
-    // text foreground color
-
-    QPixmap pix(16, 16);
-    pix.fill(QApplication::palette().foreground().color());
-    ui_->f_fgcolor->setIcon(pix);
 
-    connect(ui_->f_fgcolor, SIGNAL(clicked()), this, SLOT(textFgColor()));
+    // text foreground & background color
 
-    // text background color
-
-    pix.fill(QApplication::palette().background().color());
-    ui_->f_bgcolor->setIcon(pix);
-
-    connect(ui_->f_bgcolor, SIGNAL(clicked()), this, SLOT(textBgColor()));
+    connect(tb_->f_fgcolor, SIGNAL(clicked()), this, SLOT(textFgColor()));
+    connect(tb_->f_bgcolor, SIGNAL(clicked()), this, SLOT(textBgColor()));
 
     // images
-    connect(ui_->f_image, SIGNAL(clicked()), this, SLOT(insertImage()));
+    connect(tb_->f_image, SIGNAL(clicked()), this, SLOT(insertImage()));
+
+    // toolbar state at the cursor
+    ToolbarState state;
+    setCharState(state, ui_->f_textedit->currentCharFormat());
+    QTextList *l = ui_->f_textedit->textCursor().currentList();
+    state.list = l ? l->format().style() : 0;
+    applyToolbarState(state, true);
 }
 
 
@@ -220,11 +277,10 @@ void MRichTextEdit::textRemoveFormat() {
     //  fmt.setFontStyleHint  (QFont::SansSerif);
     //  fmt.setFontFixedPitch (true);
 
-    ui_->f_bold->setChecked(false);
-    ui_->f_underline->setChecked(false);
-    ui_->f_italic->setChecked(false);
-    ui_->f_strikeout->setChecked(false);
-    ui_->f_fontsize->setCurrentIndex(ui_->f_fontsize->findText("9"));
+    ToolbarState state = m_toolbar;
+    state.bold = state.italic = state.underline = state.strikeout = false;
+    state.pointSize = 9;
+    applyToolbarState(state);
 
     //  QTextBlockFormat bfmt = cursor.blockFormat();
     //  bfmt->setIndent(0);
@@ -236,19 +292,28 @@ void MRichTextEdit::textRemoveFormat() {
 
 
 void MRichTextEdit::textRemoveAllFormat() {
-    ui_->f_bold->setChecked(false);
-    ui_->f_underline->setChecked(false);
-    ui_->f_italic->setChecked(false);
-    ui_->f_strikeout->setChecked(false);
-    ui_->f_fontsize->setCurrentIndex(ui_->f_fontsize->findText("9"));
-    QString text = ui_->f_textedit->toPlainText();
-    ui_->f_textedit->setPlainText(text);
+    Timing::Scope timing("format.removeAll", ui_->f_textedit->document()->characterCount());
+    ToolbarState state = m_toolbar;
+    state.bold = state.italic = state.underline = state.strikeout = false;
+    state.pointSize = 9;
+    applyToolbarState(state);
+    // in place and undoable, the selection when there is one
+    const QTextCursor cursor = ui_->f_textedit->textCursor();
+    FormatRemover remover(ui_->f_textedit->document());
+    if (cursor.hasSelection()) {
+        remover.remove(cursor, m_removeFormatOptions);
+    } else {
+        remover.removeAll(m_removeFormatOptions);
+    }
+    ui_->f_textedit->setCurrentCharFormat(QTextCharFormat());
 }
 
 
 void MRichTextEdit::textBold() {
+    // the clicked button already shows the new state
+    m_toolbar.bold = tb_->f_bold->isChecked();
     QTextCharFormat fmt;
-    fmt.setFontWeight(ui_->f_bold->isChecked() ? QFont::Bold : QFont::Normal);
+    fmt.setFontWeight(tb_->f_bold->isChecked() ? QFont::Bold : QFont::Normal);
     mergeFormatOnWordOrSelection(fmt);
 }
 
@@ -259,24 +324,28 @@ void MRichTextEdit::focusInEvent(QFocusEvent *) {
 
 
 void MRichTextEdit::textUnderline() {
+    m_toolbar.underline = tb_->f_underline->isChecked();
     QTextCharFormat fmt;
-    fmt.setFontUnderline(ui_->f_underline->isChecked());
+    fmt.setFontUnderline(tb_->f_underline->isChecked());
     mergeFormatOnWordOrSelection(fmt);
 }
 
 void MRichTextEdit::textItalic() {
+    m_toolbar.italic = tb_->f_italic->isChecked();
     QTextCharFormat fmt;
-    fmt.setFontItalic(ui_->f_italic->isChecked());
+    fmt.setFontItalic(tb_->f_italic->isChecked());
     mergeFormatOnWordOrSelection(fmt);
 }
 
 void MRichTextEdit::textStrikeout() {
+    m_toolbar.strikeout = tb_->f_strikeout->isChecked();
     QTextCharFormat fmt;
-    fmt.setFontStrikeOut(ui_->f_strikeout->isChecked());
+    fmt.setFontStrikeOut(tb_->f_strikeout->isChecked());
     mergeFormatOnWordOrSelection(fmt);
 }
 
 void MRichTextEdit::textSize(const QString &p) {
+    m_toolbar.pointSize = p.toInt();
     qreal pointSize = p.toFloat();
     if (p.toFloat() > 0) {
         QTextCharFormat fmt;
@@ -286,6 +355,7 @@ void MRichTextEdit::textSize(const QString &p) {
 }
 
 void MRichTextEdit::textLink(bool checked) {
+    m_toolbar.link = checked;
     bool unlink = false;
     QTextCharFormat fmt;
     if (checked) {
@@ -317,7 +387,9 @@ void MRichTextEdit::textLink(bool checked) {
 }
 
 void MRichTextEdit::textStyle(int index) {
+    m_toolbar.paragraph = index;
     QTextCursor cursor = ui_->f_textedit->textCursor();
+    Timing::Scope timing("format.style", cursor.selectionEnd() - cursor.selectionStart());
     cursor.beginEditBlock();
 
     // standard
@@ -368,6 +440,7 @@ void MRichTextEdit::textFgColor() {
     if (!cursor.hasSelection()) {
         cursor.select(QTextCursor::WordUnderCursor);
     }
+    Timing::Scope timing("format.color", cursor.selectionEnd() - cursor.selectionStart());
     QTextCharFormat fmt = cursor.charFormat();
     if (col.isValid()) {
         fmt.setForeground(col);
@@ -386,6 +459,7 @@ void MRichTextEdit::textBgColor() {
     if (!cursor.hasSelection()) {
         cursor.select(QTextCursor::WordUnderCursor);
     }
+    Timing::Scope timing("format.background", cursor.selectionEnd() - cursor.selectionStart());
     QTextCharFormat fmt = cursor.charFormat();
     if (col.isValid()) {
         fmt.setBackground(col);
@@ -399,21 +473,22 @@ void MRichTextEdit::textBgColor() {
 }
 
 void MRichTextEdit::listBullet(bool checked) {
-    if (checked) {
-        ui_->f_list_ordered->setChecked(false);
-    }
+    ToolbarState state = m_toolbar;
+    state.list = checked ? QTextListFormat::ListDisc : 0;
+    applyToolbarState(state);
     list(checked, QTextListFormat::ListDisc);
 }
 
 void MRichTextEdit::listOrdered(bool checked) {
-    if (checked) {
-        ui_->f_list_bullet->setChecked(false);
-    }
+    ToolbarState state = m_toolbar;
+    state.list = checked ? QTextListFormat::ListDecimal : 0;
+    applyToolbarState(state);
     list(checked, QTextListFormat::ListDecimal);
 }
 
 void MRichTextEdit::list(bool checked, QTextListFormat::Style style) {
     QTextCursor cursor = ui_->f_textedit->textCursor();
+    Timing::Scope timing("format.list", cursor.selectionEnd() - cursor.selectionStart());
     cursor.beginEditBlock();
     if (!checked) {
         QTextBlockFormat obfmt = cursor.blockFormat();
@@ -437,130 +512,148 @@ void MRichTextEdit::mergeFormatOnWordOrSelection(const QTextCharFormat &format)
     if (!cursor.hasSelection()) {
         cursor.select(QTextCursor::WordUnderCursor);
     }
+    Timing::Scope timing("format.merge", cursor.selectionEnd() - cursor.selectionStart());
     cursor.mergeCharFormat(format);
     ui_->f_textedit->mergeCurrentCharFormat(format);
     ui_->f_textedit->setFocus(Qt::TabFocusReason);
 }
 
 void MRichTextEdit::slotCursorPositionChanged() {
+    ToolbarState state = m_toolbar;
     QTextList *l = ui_->f_textedit->textCursor().currentList();
-    if (m_lastBlockList && (l == m_lastBlockList || (l != 0 && m_lastBlockList != 0
-        && l->format().style() == m_lastBlockList->format().style()))) {
-        return;
-    }
-    m_lastBlockList = l;
-    if (l) {
-        QTextListFormat lfmt = l->format();
-        if (lfmt.style() == QTextListFormat::ListDisc) {
-            ui_->f_list_bullet->setChecked(true);
-            ui_->f_list_ordered->setChecked(false);
-        }
-        else if (lfmt.style() == QTextListFormat::ListDecimal) {
-            ui_->f_list_bullet->setChecked(false);
-            ui_->f_list_ordered->setChecked(true);
-        }
-        else {
-            ui_->f_list_bullet->setChecked(false);
-            ui_->f_list_ordered->setChecked(false);
-        }
-    }
-    else {
-        ui_->f_list_bullet->setChecked(false);
-        ui_->f_list_ordered->setChecked(false);
-    }
+    state.list = l ? l->format().style() : 0;
+    applyToolbarState(state);
 }
 
 void MRichTextEdit::fontChanged(const QFont &f) {
-    ui_->f_fontsize->setCurrentIndex(ui_->f_fontsize->findText(QString::number(f.pointSize())));
-    ui_->f_bold->setChecked(f.bold());
-    ui_->f_italic->setChecked(f.italic());
-    ui_->f_underline->setChecked(f.underline());
-    ui_->f_strikeout->setChecked(f.strikeOut());
+    ToolbarState state = m_toolbar;
+    setFontState(state, f);
+    applyToolbarState(state);
+}
+
+void MRichTextEdit::fgColorChanged(const QColor &c) {
+    ToolbarState state = m_toolbar;
+    state.foreground = c;
+    applyToolbarState(state);
+}
+
+void MRichTextEdit::bgColorChanged(const QColor &c) {
+    ToolbarState state = m_toolbar;
+    state.background = c;
+    applyToolbarState(state);
+}
+
+void MRichTextEdit::slotCurrentCharFormatChanged(const QTextCharFormat &format) {
+    ToolbarState state = m_toolbar;
+    setCharState(state, format);
+    applyToolbarState(state);
+}
+
+void MRichTextEdit::setCharState(ToolbarState &state, const QTextCharFormat &format) const {
+    setFontState(state, format.font());
+    state.background = format.background().isOpaque() ? format.background().color() : QColor();
+    state.foreground = format.foreground().isOpaque() ? format.foreground().color() : QColor();
+    state.link = format.isAnchor();
+}
+
+void MRichTextEdit::setFontState(ToolbarState &state, const QFont &f) const {
+    state.pointSize = f.pointSize();
+    state.bold = f.bold();
+    state.italic = f.italic();
+    state.underline = f.underline();
+    state.strikeout = f.strikeOut();
     if (f.pointSize() == m_fontsize_h1) {
-        ui_->f_paragraph->setCurrentIndex(ParagraphHeading1);
+        state.paragraph = ParagraphHeading1;
     }
     else if (f.pointSize() == m_fontsize_h2) {
-        ui_->f_paragraph->setCurrentIndex(ParagraphHeading2);
+        state.paragraph = ParagraphHeading2;
     }
     else if (f.pointSize() == m_fontsize_h3) {
-        ui_->f_paragraph->setCurrentIndex(ParagraphHeading3);
+        state.paragraph = ParagraphHeading3;
     }
     else if (f.pointSize() == m_fontsize_h4) {
-        ui_->f_paragraph->setCurrentIndex(ParagraphHeading4);
+        state.paragraph = ParagraphHeading4;
     }
-    else {
-        if (f.fixedPitch() && f.family() == "Monospace") {
-            ui_->f_paragraph->setCurrentIndex(ParagraphMonospace);
-        }
-        else {
-            ui_->f_paragraph->setCurrentIndex(ParagraphStandard);
-        }
-    }
-    if (ui_->f_textedit->textCursor().currentList()) {
-        QTextListFormat lfmt = ui_->f_textedit->textCursor().currentList()->format();
-        if (lfmt.style() == QTextListFormat::ListDisc) {
-            ui_->f_list_bullet->setChecked(true);
-            ui_->f_list_ordered->setChecked(false);
-        }
-        else if (lfmt.style() == QTextListFormat::ListDecimal) {
-            ui_->f_list_bullet->setChecked(false);
-            ui_->f_list_ordered->setChecked(true);
-        }
-        else {
-            ui_->f_list_bullet->setChecked(false);
-            ui_->f_list_ordered->setChecked(false);
-        }
+    else if (f.fixedPitch() && f.family() == "Monospace") {
+        state.paragraph = ParagraphMonospace;
     }
     else {
-        ui_->f_list_bullet->setChecked(false);
-        ui_->f_list_ordered->setChecked(false);
+        state.paragraph = ParagraphStandard;
     }
 }
 
-void MRichTextEdit::fgColorChanged(const QColor &c) {
-    QPixmap pix(16, 16);
-    if (c.isValid()) {
-        pix.fill(c);
+void MRichTextEdit::applyToolbarState(const ToolbarState &state, bool force) {
+    if (!tb_) {
+        return;
     }
-    else {
-        pix.fill(QApplication::palette().foreground().color());
+    ToolbarResources *resources = ToolbarResources::instance();
+    if (force || state.pointSize != m_toolbar.pointSize) {
+        tb_->f_fontsize->setCurrentIndex(resources->fontSizeIndex(state.pointSize));
     }
-    ui_->f_fgcolor->setIcon(pix);
-}
-
-void MRichTextEdit::bgColorChanged(const QColor &c) {
-    QPixmap pix(16, 16);
-    if (c.isValid()) {
-        pix.fill(c);
+    if (force || state.paragraph != m_toolbar.paragraph) {
+        tb_->f_paragraph->setCurrentIndex(state.paragraph);
     }
-    else {
-        pix.fill(QApplication::palette().background().color());
+    if (force || state.list != m_toolbar.list) {
+        tb_->f_list_bullet->setChecked(state.list == QTextListFormat::ListDisc);
+        tb_->f_list_ordered->setChecked(state.list == QTextListFormat::ListDecimal);
     }
-    ui_->f_bgcolor->setIcon(pix);
-}
-
-void MRichTextEdit::slotCurrentCharFormatChanged(const QTextCharFormat &format) {
-    fontChanged(format.font());
-    bgColorChanged((format.background().isOpaque()) ? format.background().color() : QColor());
-    fgColorChanged((format.foreground().isOpaque()) ? format.foreground().color() : QColor());
-    ui_->f_link->setChecked(format.isAnchor());
+    if (force || state.bold != m_toolbar.bold) {
+        tb_->f_bold->setChecked(state.bold);
+    }
+    if (force || state.italic != m_toolbar.italic) {
+        tb_->f_italic->setChecked(state.italic);
+    }
+    if (force || state.underline != m_toolbar.underline) {
+        tb_->f_underline->setChecked(state.underline);
+    }
+    if (force || state.strikeout != m_toolbar.strikeout) {
+        tb_->f_strikeout->setChecked(state.strikeout);
+    }
+    if (force || state.link != m_toolbar.link) {
+        tb_->f_link->setChecked(state.link);
+    }
+    if (force || state.foreground != m_toolbar.foreground) {
+        tb_->f_fgcolor->setIcon(resources->colorSwatch(state.foreground.isValid()
+            ? state.foreground : QApplication::palette().foreground().color()));
+    }
+    if (force || state.background != m_toolbar.background) {
+        tb_->f_bgcolor->setIcon(resources->colorSwatch(state.background.isValid()
+            ? state.background : QApplication::palette().background().color()));
+    }
+    m_toolbar = state;
 }
 
 void MRichTextEdit::slotClipboardDataChanged() {
-#ifndef QT_NO_CLIPBOARD
-    if (const QMimeData *md = QApplication::clipboard()->mimeData())
-        ui_->f_paste->setEnabled(md->hasText());
-#endif
+    tb_->f_paste->setEnabled(ToolbarResources::instance()->canPaste());
 }
 
 QString MRichTextEdit::toHtml() const {
-    QString s = ui_->f_textedit->toHtml();
-    // convert emails to links
-    s = s.replace(QRegExp("(<[^a][^>]+>(?:<span[^>]+>)?|\\s)([a-zA-Z\\d]+@[a-zA-Z\\d]+\\.[a-zA-Z]+)"), "\\1<a href=\"mailto:\\2\">\\2</a>");
-    // convert links
-    s = s.replace(QRegExp("(<[^a][^>]+>(?:<span[^>]+>)?|\\s)((?:https?|ftp|file)://[^\\s'\"<>]+)"), "\\1<a href=\"\\2\">\\2</a>");
-    // see also: Utils::linkify()
-    return s;
+    // convert emails and links, only blocks changed since the last call are scanned
+    Timing::Scope timing("toHtml");
+    const QString html = ui_->f_textedit->embedImages(m_linkifier->toHtml());
+    timing.setSize(html.size());
+    return html;
+}
+
+HtmlLoader *MRichTextEdit::loadHtml(QIODevice *device) {
+    if (!m_loader) {
+        m_loader = new HtmlLoader(ui_->f_textedit->document(), this);
+        m_loader->setImageStore(ui_->f_textedit->imageStore());
+    }
+    m_loader->start(device);
+    return m_loader;
+}
+
+bool MRichTextEdit::writeHtml(QIODevice *device) const {
+    Timing::Scope timing("writeHtml");
+    MTextEdit *edit = ui_->f_textedit;
+    edit->flushPendingImages();
+    HtmlWriter writer(edit->document());
+    writer.setLinkifier(m_linkifier);
+    writer.setImageStore(edit->imageStore(), edit->imageEmbedding(), edit->imageDirectory());
+    const bool written = writer.write(device);
+    timing.setSize(device->pos());
+    return written;
 }
 
 QTextDocument * MRichTextEdit::document()
@@ -588,6 +681,7 @@ void MRichTextEdit::decreaseIndentation() {
 
 void MRichTextEdit::indent(int delta) {
     QTextCursor cursor = ui_->f_textedit->textCursor();
+    Timing::Scope timing("format.indent", cursor.selectionEnd() - cursor.selectionStart());
     cursor.beginEditBlock();
     QTextBlockFormat bfmt = cursor.blockFormat();
     int ind = bfmt.indent();
@@ -598,6 +692,47 @@ void MRichTextEdit::indent(int delta) {
     cursor.endEditBlock();
 }
 
+void MRichTextEdit::setRemoveFormatOptions(FormatRemover::Options options)
+{
+    m_removeFormatOptions = options;
+}
+
+void MRichTextEdit::setImageFormat(const QString& format, int quality)
+{
+    ui_->f_textedit->setImageFormat(format);
+    ui_->f_textedit->setImageQuality(quality);
+}
+
+QString MRichTextEdit::imageFormat() const
+{
+    return ui_->f_textedit->imageFormat();
+}
+
+void MRichTextEdit::setImageEmbedding(ImageStore::Embedding embedding, const QString& directory)
+{
+    ui_->f_textedit->setImageEmbedding(embedding, directory);
+}
+
+Autosave *MRichTextEdit::startAutosave(const QString &path)
+{
+    return new Autosave(ui_->f_textedit->document(), path, ui_->f_textedit->imageStore(), this);
+}
+
+bool MRichTextEdit::recoverAutosave(const QString &path)
+{
+    return Autosave::recover(path, ui_->f_textedit->document(), ui_->f_textedit->imageStore());
+}
+
+void MRichTextEdit::setUndoBudget(qint64 bytes)
+{
+    ui_->f_textedit->setUndoBudget(bytes);
+}
+
+qint64 MRichTextEdit::undoMemory() const
+{
+    return ui_->f_textedit->undoMemory();
+}
+
 void MRichTextEdit::setText(const QString& text, bool html/* = false*/) {
     if (text.isEmpty()) {
         setPlainText(text);
@@ -614,12 +749,19 @@ void MRichTextEdit::setText(const QString& text, bool html/* = false*/) {
 
 void MRichTextEdit::setPlainText(const QString &text)
 {
+    Timing::Scope timing("setPlainText", text.size());
     ui_->f_textedit->setPlainText(text);
 }
 
 void MRichTextEdit::setHtml(const QString &text)
 {
-    ui_->f_textedit->setHtml(text);
+    Timing::Scope timing("setHtml", text.size());
+    ui_->f_textedit->setHtml(ui_->f_textedit->absorbImages(text));
+}
+
+QString MRichTextEdit::absorbImages(const QString &html)
+{
+    return ui_->f_textedit->absorbImages(html);
 }
 
 void MRichTextEdit::insertImage() {
@@ -629,9 +771,7 @@ void MRichTextEdit::insertImage() {
         tr("Select an image"),
         attdir,
         tr("JPEG (*.jpg);; GIF (*.gif);; PNG (*.png);; BMP (*.bmp);; All (*)"));
-    QImage image = QImageReader(file).read();
-
-    ui_->f_textedit->dropImage(image, QFileInfo(file).suffix().toUpper().toLocal8Bit().data());
+    ui_->f_textedit->insertImageFile(file, QFileInfo(file).suffix().toUpper());
 
 }
 
@@ -24,30 +24,75 @@
 #ifndef _MRICHTEXTEDIT_H_
 #define _MRICHTEXTEDIT_H_
 
-#include <QPointer>
 #include <QWidget>
 #include "QTextDocument"
 #include "QTextFormat"
 #include "QTextList"
+#include "ImageStore.h"
+#include "FormatRemover.h"
+
+class QIODevice;
 
 /**
  * @Brief A simple rich-text editor
  */
 namespace Ui {
     class MRichTextEdit;
+    class RichTextToolbar;
 };
 
+class Linkifier;
+class HtmlLoader;
+class Autosave;
+
 class MRichTextEdit : public QWidget {
     Q_OBJECT
 public:
+    enum ToolbarMode {
+        ToolbarEmbedded,    // built with the editor
+        ToolbarOnFocus      // built when the editor first gets focus, for forms with many editors
+    };
+
     MRichTextEdit(QWidget *parent = 0);
+    explicit MRichTextEdit(ToolbarMode mode, QWidget *parent = 0);
+    ~MRichTextEdit();
+
+    ToolbarMode    toolbarMode() const { return m_toolbarMode; }
+    bool           hasToolbar() const { return tb_ != nullptr; }
+    void           ensureToolbar();
 
     QString toPlainText() const;
     QString toHtml() const;
+    // reads HTML in pieces between event loop turns, the beginning can be
+    // edited while the rest loads; the loader reports progress and cancels
+    HtmlLoader *loadHtml(QIODevice *device);
+    // the document written as UTF-8 HTML block by block, with links and
+    // image data encoded straight into the device
+    bool    writeHtml(QIODevice *device) const;
+    // moves the data URIs of html into the image store, see MTextEdit
+    QString absorbImages(const QString &html);
     QTextDocument *document();
     QTextCursor    textCursor() const;
     void           setTextCursor(const QTextCursor& cursor);
 
+    // format inserted and pasted images are encoded in, e.g. "PNG" or "JPG";
+    // empty keeps the format of the source, pasted PNG and JPEG bytes are
+    // kept as they are
+    void           setImageFormat(const QString& format, int quality = -1);
+    QString        imageFormat() const;
+    // what "remove all formatting" keeps, images and lists go by default
+    void           setRemoveFormatOptions(FormatRemover::Options options);
+    FormatRemover::Options removeFormatOptions() const { return m_removeFormatOptions; }
+    // how images are written by toHtml() and writeHtml()
+    void           setImageEmbedding(ImageStore::Embedding embedding, const QString& directory = QString());
+    // keeps a crash recovery copy at path, see Autosave; owned by the editor
+    Autosave      *startAutosave(const QString &path);
+    // the copy Autosave left at path, false when there is none
+    bool           recoverAutosave(const QString &path);
+    // bytes the undo history may hold, see UndoBudget; 0 for no limit
+    void           setUndoBudget(qint64 bytes);
+    qint64         undoMemory() const;
+
 signals:
     void textChanged();
 
@@ -83,9 +128,30 @@ protected:
     void fontChanged(const QFont &f);
     void fgColorChanged(const QColor &c);
     void bgColorChanged(const QColor &c);
+
+    // what the toolbar shows; a cursor move computes the new state and only
+    // the widgets whose part of it changed are touched
+    struct ToolbarState {
+        int pointSize = -1;
+        int paragraph = -1;
+        int list = -1;          // QTextListFormat::Style, 0 outside a list
+        bool bold = false;
+        bool italic = false;
+        bool underline = false;
+        bool strikeout = false;
+        bool link = false;
+        QColor foreground;      // invalid: the palette's
+        QColor background;
+    };
+    void setFontState(ToolbarState &state, const QFont &f) const;
+    void setCharState(ToolbarState &state, const QTextCharFormat &format) const;
+    void applyToolbarState(const ToolbarState &state, bool force = false);
+
     void list(bool checked, QTextListFormat::Style style);
     void indent(int delta);
     void focusInEvent(QFocusEvent *event);
+    bool eventFilter(QObject *watched, QEvent *event) override;
+    void createToolbar();
 
     QStringList m_paragraphItems;
     int m_fontsize_h1;
@@ -102,9 +168,15 @@ protected:
         ParagraphMonospace
     };
 
-    QPointer<QTextList> m_lastBlockList;
+    ToolbarMode m_toolbarMode;
+    ToolbarState m_toolbar;
+    Linkifier *m_linkifier;
+    HtmlLoader *m_loader = nullptr;
+    FormatRemover::Options m_removeFormatOptions = FormatRemover::NoOptions;
 
     Ui::MRichTextEdit * ui_ = nullptr;
+    Ui::RichTextToolbar * tb_ = nullptr;    // null until the toolbar is built
+    QWidget *m_toolbarSpace = nullptr;      // holds the toolbar's room until then
 };
 
 #endif
@@ -5,10 +5,44 @@
 #include <QImage>
 #include <QByteArray>
 #include <QBuffer>
-#include <stdlib.h>
+#include <QImageReader>
+#include <QThreadPool>
+#include <QUrl>
+#include "ImageEncoder.h"
+#include "Timing.h"
+#include "UndoBudget.h"
 
+namespace {
 
-MTextEdit::MTextEdit(QWidget *parent) : QTextEdit(parent) {
+struct MimeFormat {
+    const char *type;
+    const char *format;
+};
+
+// formats the clipboard offers already encoded come first
+const MimeFormat mimeFormats[] = {
+    { "image/png",  "PNG"  },
+    { "image/jpeg", "JPG"  },
+    { "image/jpg",  "JPG"  },
+    { "image/gif",  "GIF"  },
+    { "image/bmp",  "BMP"  },
+    { "image/pbm",  "PBM"  },
+    { "image/pgm",  "PGM"  },
+    { "image/ppm",  "PPM"  },
+    { "image/tiff", "TIFF" },
+    { "image/xbm",  "XBM"  },
+    { "image/xpm",  "XPM"  },
+};
+
+}
+
+MTextEdit::MTextEdit(QWidget *parent)
+    : QTextEdit(parent)
+    , m_imageFormat("PNG")
+    , m_imageQuality(-1)
+    , m_nextImage(0)
+    , m_embedding(ImageStore::DataUris) {
+    m_undoBudget = new UndoBudget(document(), &m_store, this);
 }
 
 
@@ -19,24 +53,14 @@ bool MTextEdit::canInsertFromMimeData(const QMimeData *source) const {
 
 void MTextEdit::insertFromMimeData(const QMimeData *source) {
     if (source->hasImage()) {
-        QStringList formats = source->formats();
-        QString format;
-        for (int i=0; i<formats.size(); i++) {
-            if (formats[i] == "image/bmp")  { format = "BMP";  break; }
-            if (formats[i] == "image/jpeg") { format = "JPG";  break; }
-            if (formats[i] == "image/jpg")  { format = "JPG";  break; }
-            if (formats[i] == "image/gif")  { format = "GIF";  break; }
-            if (formats[i] == "image/png")  { format = "PNG";  break; }
-            if (formats[i] == "image/pbm")  { format = "PBM";  break; }
-            if (formats[i] == "image/pgm")  { format = "PGM";  break; }
-            if (formats[i] == "image/ppm")  { format = "PPM";  break; }
-            if (formats[i] == "image/tiff") { format = "TIFF"; break; }
-            if (formats[i] == "image/xbm")  { format = "XBM";  break; }
-            if (formats[i] == "image/xpm")  { format = "XPM";  break; }
-            }
-        if (!format.isEmpty()) {
-//          dropImage(qvariant_cast<QImage>(source->imageData()), format);
-            dropImage(qvariant_cast<QImage>(source->imageData()), "JPG"); // Sorry, ale cokoli jiného dlouho trvá
+        for (const MimeFormat& mime : mimeFormats) {
+            if (!source->hasFormat(mime.type)) {
+                continue;
+                }
+            if (keepsEncoded(mime.format) && insertEncodedImage(source->data(mime.type), mime.format)) {
+                return;
+                }
+            dropImage(qvariant_cast<QImage>(source->imageData()), mime.format);
             return;
             }
         }
@@ -45,33 +69,163 @@ void MTextEdit::insertFromMimeData(const QMimeData *source) {
 
 
 QMimeData *MTextEdit::createMimeDataFromSelection() const {
-    return QTextEdit::createMimeDataFromSelection();
+    QMimeData *data = QTextEdit::createMimeDataFromSelection();
+    if (data->hasHtml()) {
+        data->setHtml(embedImages(data->html()));
+        }
+    return data;
 }
 
 
-void MTextEdit::dropImage(const QImage& image, const QString& format) {
-    QByteArray bytes;
-    QBuffer buffer(&bytes);
-    buffer.open(QIODevice::WriteOnly);
-    image.save(&buffer, format.toLocal8Bit().data());
-    buffer.close();
-    QByteArray base64 = bytes.toBase64();
-    QByteArray base64l;
-    for (int i=0; i<base64.size(); i++) {
-        base64l.append(base64[i]);
-        if (i%80 == 0) {
-            base64l.append("\n");
-            }
+QByteArray MTextEdit::outputFormat(const QString& sourceFormat) const {
+    return (m_imageFormat.isEmpty() ? sourceFormat : m_imageFormat).toUpper().toLatin1();
+}
+
+
+QString MTextEdit::insertPlaceholder(const QSize& size, const QByteArray& format, const QImage& image) {
+    // an alias until the encoded bytes tell the content hash
+    const QString name = QString("image-%1.%2").arg(++m_nextImage).arg(QString(format).toLower());
+    Pending pending;
+    pending.format = format;
+    pending.image = image;
+    m_pending.insert(name, pending);
+    insertImageFormat(name, size, image);
+    return name;
+}
+
+
+void MTextEdit::insertImageFormat(const QString& name, const QSize& size, const QImage& shown) {
+    // without an image yet a tiny stand-in is stretched to the size
+    QImage resource = shown;
+    if (resource.isNull()) {
+        resource = QImage(1, 1, QImage::Format_RGB32);
+        resource.fill(palette().color(QPalette::Mid));
         }
+    document()->addResource(QTextDocument::ImageResource, QUrl(name), resource);
 
-    QTextCursor cursor = textCursor();
     QTextImageFormat imageFormat;
-    imageFormat.setWidth  ( image.width() );
-    imageFormat.setHeight ( image.height() );
-    imageFormat.setName   ( QString("data:image/%1;base64,%2")
-                                .arg(QString("%1.%2").arg(rand()).arg(format))
-                                .arg(base64l.data())
-                                );
-    cursor.insertImage    ( imageFormat );
+    imageFormat.setWidth  ( size.width() );
+    imageFormat.setHeight ( size.height() );
+    imageFormat.setName   ( name );
+    textCursor().insertImage(imageFormat);
+}
+
+
+bool MTextEdit::keepsEncoded(const QByteArray& format) const {
+    // encoding them again in the configured format costs time and rarely saves bytes
+    return format == "PNG" || format == "JPG";
+}
+
+
+bool MTextEdit::insertEncodedImage(const QByteArray& bytes, const QByteArray& format) {
+    // the header is enough to know the size, the bytes are stored as they are
+    QBuffer buffer;
+    buffer.setData(bytes);
+    buffer.open(QIODevice::ReadOnly);
+    const QSize size = QImageReader(&buffer, format).size();
+    if (!size.isValid()) {
+        return false;
+        }
+    const QString name = m_store.add(bytes, format);
+    insertImageFormat(name, size, QImage());
+    ImageEncoder *decoder = new ImageEncoder(name, bytes);
+    connect(decoder, &ImageEncoder::encoded, this, &MTextEdit::imageEncoded);
+    QThreadPool::globalInstance()->start(decoder);
+    return true;
+}
+
+
+void MTextEdit::dropImage(const QImage& image, const QString& format) {
+    if (image.isNull()) {
+        return;
+        }
+    Timing::Scope timing("dropImage", image.byteCount());
+    const QByteArray output = outputFormat(format);
+    const QString name = insertPlaceholder(image.size(), output, image);
+    ImageEncoder *encoder = new ImageEncoder(name, image, output, m_imageQuality);
+    connect(encoder, &ImageEncoder::encoded, this, &MTextEdit::imageEncoded);
+    QThreadPool::globalInstance()->start(encoder);
+}
+
+
+void MTextEdit::insertImageFile(const QString& path, const QString& format) {
+    // only the header is read here, decoding happens with the encoding
+    const QSize size = QImageReader(path).size();
+    if (!size.isValid()) {
+        return;
+        }
+    const QByteArray output = outputFormat(format);
+    const QString name = insertPlaceholder(size, output, QImage());
+    m_pending[name].path = path;
+    ImageEncoder *encoder = new ImageEncoder(name, path, output, m_imageQuality);
+    connect(encoder, &ImageEncoder::encoded, this, &MTextEdit::imageEncoded);
+    QThreadPool::globalInstance()->start(encoder);
+}
+
+
+void MTextEdit::imageEncoded(const QString& name, const QImage& image, const QByteArray& bytes, const QByteArray& key) {
+    // not pending when serialized meanwhile or when the bytes were only decoded
+    auto it = m_pending.find(name);
+    if (it != m_pending.end()) {
+        m_store.addAlias(name, m_store.add(bytes, it->format, key));
+        m_pending.erase(it);
+        }
+    // the resource is replaced without touching the text, so the undo stack
+    // keeps just the insertion; undone images still find their pixels on redo
+    if (!image.isNull()) {
+        document()->addResource(QTextDocument::ImageResource, QUrl(name), image);
+        viewport()->update();
+        }
+    emit imageReady(name);
+}
+
+
+void MTextEdit::flushPendingImages() const {
+    for (auto it = m_pending.cbegin(); it != m_pending.cend(); ++it) {
+        const QImage image = it->image.isNull() ? QImageReader(it->path).read() : it->image;
+        m_store.addAlias(it.key(), m_store.add(ImageEncoder::encode(image, it->format, m_imageQuality), it->format));
+        }
+    m_pending.clear();
+}
+
+
+void MTextEdit::setImageEmbedding(ImageStore::Embedding embedding, const QString& directory) {
+    m_embedding = embedding;
+    m_imageDirectory = directory;
+}
+
+
+QVariant MTextEdit::loadResource(int type, const QUrl& name) {
+    // stored images are decoded only when the layout asks for them
+    if (type == QTextDocument::ImageResource && m_store.contains(name.toString())) {
+        return QImage::fromData(m_store.bytes(name.toString()));
+        }
+    return QTextEdit::loadResource(type, name);
+}
+
+
+QString MTextEdit::absorbImages(const QString& html) {
+    return m_store.absorb(html);
+}
+
+
+QString MTextEdit::embedImages(const QString& html) const {
+    flushPendingImages();
+    return m_store.serialize(html, m_embedding, m_imageDirectory);
+}
+
+
+void MTextEdit::setUndoBudget(qint64 bytes) {
+    m_undoBudget->setBudget(bytes);
+}
+
+
+qint64 MTextEdit::undoBudget() const {
+    return m_undoBudget->budget();
+}
+
+
+qint64 MTextEdit::undoMemory() const {
+    return m_undoBudget->memoryUsage();
 }
 
@@ -4,19 +4,82 @@
 #include <QTextEdit>
 #include <QMimeData>
 #include <QImage>
+#include <QHash>
+#include "ImageStore.h"
+
+class UndoBudget;
 
 class MTextEdit : public QTextEdit {
     Q_OBJECT
 public:
     MTextEdit(QWidget *parent);
 
+    // images are encoded on a thread pool, the editor shows them meanwhile
     void        dropImage(const QImage& image, const QString& format);
+    void        insertImageFile(const QString& path, const QString& format);
+
+    // format images are encoded in, empty keeps the format they came in;
+    // PNG and JPEG bytes on the clipboard are stored as they are
+    void        setImageFormat(const QString& format) { m_imageFormat = format; }
+    QString     imageFormat() const { return m_imageFormat; }
+    void        setImageQuality(int quality) { m_imageQuality = quality; }
+    int         imageQuality() const { return m_imageQuality; }
+
+    bool        hasPendingImages() const { return !m_pending.isEmpty(); }
+    ImageStore *imageStore() { return &m_store; }
+    const ImageStore *imageStore() const { return &m_store; }
+    void        setImageEmbedding(ImageStore::Embedding embedding, const QString& directory = QString());
+    ImageStore::Embedding imageEmbedding() const { return m_embedding; }
+    QString     imageDirectory() const { return m_imageDirectory; }
+    // encodes the images still in the pool, so the store has them all
+    void        flushPendingImages() const;
+
+    // moves data URIs of html into the image store
+    QString     absorbImages(const QString& html);
+    // replaces the image names in html by data URIs or file names
+    QString     embedImages(const QString& html) const;
+
+    // bytes the undo history may hold before its oldest steps are dropped,
+    // 0 for no limit
+    void        setUndoBudget(qint64 bytes);
+    qint64      undoBudget() const;
+    qint64      undoMemory() const;
+
+signals:
+    void        imageReady(const QString& name);
 
 protected:
     bool        canInsertFromMimeData(const QMimeData *source) const;
     void        insertFromMimeData(const QMimeData *source);
     QMimeData  *createMimeDataFromSelection() const;
+    QVariant    loadResource(int type, const QUrl& name);
+
+private slots:
+    void        imageEncoded(const QString& name, const QImage& image, const QByteArray& bytes, const QByteArray& key);
+
+private:
+    // an image still in the pool
+    struct Pending {
+        QByteArray format;
+        QImage image;
+        QString path;
+    };
+
+    QString     insertPlaceholder(const QSize& size, const QByteArray& format, const QImage& image);
+    bool        keepsEncoded(const QByteArray& format) const;
+    bool        insertEncodedImage(const QByteArray& bytes, const QByteArray& format);
+    void        insertImageFormat(const QString& name, const QSize& size, const QImage& shown);
+    QByteArray  outputFormat(const QString& sourceFormat) const;
 
+    QString     m_imageFormat;
+    int         m_imageQuality;
+    int         m_nextImage;
+    ImageStore::Embedding m_embedding;
+    QString     m_imageDirectory;
+    // serializing encodes what is still pending on the spot
+    mutable QHash<QString, Pending> m_pending;
+    mutable ImageStore m_store;
+    UndoBudget *m_undoBudget;
 };
 
 #endif
@@ -1,23 +1,73 @@
 #include "stdafx.h"
 #include "sourceeditor.h"
 #include <QHBoxLayout>
-#include "mtextedit.h"
+#include <QTimer>
+#include <QThread>
+#include <QScrollBar>
+#include <QTextBlock>
+#include <QTextCursor>
+#include <QTextDocumentFragment>
+#include "SourceView.h"
 #include "HtmlHighlighter.h"
 #include "mrichtextedit.h"
 
+namespace {
+
+// QTextDocument::toHtml() writes every block of the body on its own line,
+// so a body line stands for one block of the rich document
+struct HtmlBody {
+    int begin = -1;
+    int end = -1;
+    QVector<QStringRef> lines;
+
+    bool parse(const QString &html) {
+        const int body = html.indexOf("<body");
+        const int open = body == -1 ? -1 : html.indexOf('>', body);
+        end = html.lastIndexOf("</body>");
+        if (open == -1 || end <= open) {
+            return false;
+        }
+        begin = open + 1;
+        if (begin < end && html.at(begin) == '\n') {
+            ++begin;
+        }
+        lines = html.midRef(begin, end - begin).split('\n');
+        return true;
+    }
+};
+
+// lists and tables span several lines, patching a part of them is not safe
+bool isStructural(const QStringRef &line) {
+    static const char *const tags[] = { "<ul", "<ol", "<li", "</ul", "</ol", "<table", "<tr", "<td", "<th", "</table" };
+    for (const char *tag : tags) {
+        if (line.contains(QLatin1String(tag))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+}
+
 SourceEditor::SourceEditor(MRichTextEdit *parent)
     : QDialog(nullptr)
+    , rich_(parent)
 {
     QHBoxLayout *layout = new QHBoxLayout(this);
-    edit_ = new MTextEdit(this);
+    edit_ = new SourceView(this);
     layout->addWidget(edit_);
 
     syntax_ = new HtmlHighlighter(edit_->document());
-    edit_->setPlainText(parent->toHtml());
+    syntax_->setMode(QThread::idealThreadCount() > 1 ? HtmlHighlighter::Threaded : HtmlHighlighter::Progressive);
+    applied_ = parent->toHtml();
+    edit_->setPlainText(applied_);
+    connect(edit_->verticalScrollBar(), &QScrollBar::valueChanged, this, &SourceEditor::updateVisibleBlocks);
 
-    connect(edit_, &MTextEdit::textChanged, [=]() {
-        parent->setText(edit_->toPlainText(), true);
-    });
+    syncTimer_ = new QTimer(this);
+    syncTimer_->setSingleShot(true);
+    syncTimer_->setInterval(300);
+    connect(syncTimer_, &QTimer::timeout, this, &SourceEditor::applySource);
+    connect(edit_, &SourceView::textChanged, this, &SourceEditor::sourceChanged);
 }
 
 SourceEditor::~SourceEditor()
@@ -27,3 +77,125 @@ SourceEditor::~SourceEditor()
         syntax_ = nullptr;
     }
 }
+
+void SourceEditor::setSyncMode(SyncMode mode)
+{
+    mode_ = mode;
+    if (mode_ == SyncImmediate && syncTimer_->isActive()) {
+        applySource();
+    }
+}
+
+void SourceEditor::setSyncDelay(int msec)
+{
+    syncTimer_->setInterval(msec);
+}
+
+void SourceEditor::done(int r)
+{
+    if (syncTimer_->isActive()) {
+        applySource();
+    }
+    QDialog::done(r);
+}
+
+void SourceEditor::resizeEvent(QResizeEvent *event)
+{
+    QDialog::resizeEvent(event);
+    updateVisibleBlocks();
+}
+
+void SourceEditor::updateVisibleBlocks()
+{
+    syntax_->setVisibleBlocks(edit_->firstVisibleBlockNumber(), edit_->lastVisibleBlockNumber());
+}
+
+void SourceEditor::sourceChanged()
+{
+    if (mode_ == SyncImmediate) {
+        applySource();
+    } else {
+        syncTimer_->start();
+    }
+}
+
+void SourceEditor::applySource()
+{
+    syncTimer_->stop();
+    const QString source = edit_->toPlainText();
+    if (source == applied_) {
+        return;
+    }
+    if (mode_ == SyncImmediate || !patchDocument(source)) {
+        rich_->setText(source, true);
+    }
+    applied_ = source;
+}
+
+bool SourceEditor::patchDocument(const QString &source)
+{
+    HtmlBody before, after;
+    if (!before.parse(applied_) || !after.parse(source)) {
+        return false;
+    }
+    // head or body attributes changed: the whole document is affected
+    if (applied_.leftRef(before.begin) != source.leftRef(after.begin)
+        || applied_.midRef(before.end) != source.midRef(after.end)) {
+        return false;
+    }
+
+    QTextDocument *doc = rich_->document();
+    const int oldCount = before.lines.size();
+    const int newCount = after.lines.size();
+    if (doc->blockCount() != oldCount) {
+        return false;
+    }
+
+    int prefix = 0;
+    while (prefix < oldCount && prefix < newCount && before.lines[prefix] == after.lines[prefix]) {
+        ++prefix;
+    }
+    int suffix = 0;
+    while (suffix < oldCount - prefix && suffix < newCount - prefix
+           && before.lines[oldCount - 1 - suffix] == after.lines[newCount - 1 - suffix]) {
+        ++suffix;
+    }
+    // replace at least one whole block on both sides
+    if (oldCount - prefix - suffix == 0 || newCount - prefix - suffix == 0) {
+        if (prefix > 0) {
+            --prefix;
+        } else if (suffix > 0) {
+            --suffix;
+        } else {
+            return false;
+        }
+    }
+
+    QString html = source.left(after.begin);
+    for (int i = prefix; i < newCount - suffix; ++i) {
+        if (isStructural(after.lines[i])) {
+            return false;
+        }
+        if (i > prefix) {
+            html += '\n';
+        }
+        html += after.lines[i];
+    }
+    for (int i = prefix; i < oldCount - suffix; ++i) {
+        if (isStructural(before.lines[i])) {
+            return false;
+        }
+    }
+    html += source.midRef(after.end);
+
+    const QTextBlock first = doc->findBlockByNumber(prefix);
+    const QTextBlock last = doc->findBlockByNumber(oldCount - suffix - 1);
+    QTextCursor cursor(doc);
+    cursor.beginEditBlock();
+    cursor.setPosition(first.position());
+    cursor.setPosition(last.position() + last.length() - 1, QTextCursor::KeepAnchor);
+    // data URIs go to the image store like on setText(), not into the formats
+    cursor.insertFragment(QTextDocumentFragment::fromHtml(rich_->absorbImages(html), doc));
+    cursor.endEditBlock();
+    return true;
+}
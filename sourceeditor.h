@@ -4,16 +4,43 @@
 
 class MRichTextEdit;
 class HtmlHighlighter;
-class MTextEdit;
+class SourceView;
+class QTimer;
 class SourceEditor : public QDialog
 {
     Q_OBJECT
 
 public:
+    enum SyncMode {
+        SyncImmediate,  // every keystroke reloads the rich document
+        SyncDebounced   // keystrokes are batched and only changed blocks are patched
+    };
+
     SourceEditor(MRichTextEdit *parent);
     ~SourceEditor();
 
+    void setSyncMode(SyncMode mode);
+    SyncMode syncMode() const { return mode_; }
+    void setSyncDelay(int msec);
+
+public slots:
+    void done(int r) override;
+
+private slots:
+    void sourceChanged();
+    void applySource();
+    void updateVisibleBlocks();
+
+protected:
+    void resizeEvent(QResizeEvent *event) override;
+
 private:
+    bool patchDocument(const QString &source);
+
+    MRichTextEdit *rich_ = nullptr;
     HtmlHighlighter *syntax_ = nullptr;
-    MTextEdit * edit_ = nullptr;
+    SourceView *edit_ = nullptr;
+    QTimer *syncTimer_ = nullptr;
+    SyncMode mode_ = SyncDebounced;
+    QString applied_;
 };